@@ -0,0 +1,628 @@
+
+/* throughput and latency benchmark for lfht.
+ *
+ * prefills a table to a given fraction of a fixed key space, then runs a
+ * configurable mix of lfht_get(), lfht_add(), and lfht_del() from several
+ * threads. reads pick keys from the whole key space; adds and deletes stay
+ * within a per-thread partition so that each thread knows which of its keys
+ * are present. reports ops/sec and p50/p99/p99.9 latency per operation, once
+ * per thread count given.
+ *
+ * usage: lfht_bench [-t threads[,threads...]] [-n keys] [-o ops_per_thread]
+ *   [-p prefill%] [-r read%] [-w add%] [-d del%]
+ *   [-k uniform|zipf|seq] [-z zipf_theta] [-i initial_size]
+ *   [-l latency_sample_interval] [-S seed] [-b] [-g batch] [-s] [-c] [-C] [-M]
+ *   [-T] [-I]
+ *
+ * -b prefills with lfht_add_bulk() instead of a series of lfht_add().
+ * -g does reads in batches of the given size with lfht_get_batch(); each
+ * batch counts as that many reads, and the latency recorded per read is that
+ * of the batch divided by its size.
+ * -s sets LFHT_STORE_HASH, so that migration doesn't dereference the items.
+ * -c sets LFHT_CHECK_HASH, so that lookups filter candidates by stored hash.
+ * -C sets LFHT_CTRL_BYTES, so that lookups scan per-slot tag bytes first.
+ * -M sets LFHT_READ_MIGRATE, so that lookups help migration along.
+ * -T goes through the LFHT_DEFINE_TYPE() front-end rather than lfht_get() and
+ * friends, with the same precomputed hashes, for a comparison of the two.
+ * -I stores the keys themselves with lfht_int_add() and friends, so that
+ * there's no item to chase or hash to look up.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <ccan/container_of/container_of.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+#include "lfht_type.h"
+
+
+#define MAX_THREAD_COUNTS 16
+
+enum op { OP_GET = 0, OP_ADD, OP_DEL, N_OPS };
+enum dist { DIST_UNIFORM = 0, DIST_ZIPF, DIST_SEQ };
+
+static const char *const op_names[N_OPS] = { "get", "add", "del" };
+static const char *const dist_names[] = { "uniform", "zipf", "seq" };
+
+
+struct item {
+	uint64_t key;
+	size_t hash;
+} __attribute__((aligned(32)));	/* lfht wants a malloc grain's worth */
+
+
+struct zipf {
+	uint64_t n;
+	double theta, alpha, zetan, eta;
+};
+
+
+struct config {
+	int thread_counts[MAX_THREAD_COUNTS], n_thread_counts;
+	size_t n_keys, ops, initial_size;
+	int prefill_pct, mix[N_OPS], lat_interval, batch;
+	unsigned int flags;
+	bool bulk, typed, ints;
+	enum dist dist;
+	double theta;
+	unsigned long seed;
+};
+
+
+struct lat_log {
+	uint32_t *ns;
+	size_t n, cap;
+};
+
+
+struct worker {
+	pthread_t thread;
+	int id, n_threads;
+	const struct config *cfg;
+	struct lfht *ht;
+	struct item *items;
+	bool *present;		/* for own partition */
+	size_t part_first, part_size;
+	uint64_t rng, seq;
+	struct zipf zipf;
+	size_t counts[N_OPS], hits;
+	struct lat_log lat[N_OPS];
+	size_t *batch_hashes;
+	void **batch_keys, **batch_out;
+};
+
+
+static pthread_barrier_t start_bar;
+
+
+static size_t item_hash(uint64_t key) {
+	return hashl(&key, 1, 0);
+}
+
+
+static size_t rehash_item(const void *ptr, void *priv) {
+	const struct item *it = ptr;
+	return it->hash;
+}
+
+
+static bool cmp_item(const void *cand, void *ref) {
+	const struct item *a = cand, *b = ref;
+	return a->key == b->key;
+}
+
+
+/* the same thing for LFHT_DEFINE_TYPE(), where the key is an item carrying a
+ * precomputed hash just as for lfht_get().
+ */
+static inline const struct item *item_self(const struct item *it) {
+	return it;
+}
+
+
+static inline size_t item_keyhash(const struct item *key) {
+	return key->hash;
+}
+
+
+static inline bool item_eq(const struct item *cand, const struct item *key) {
+	return cand->key == key->key;
+}
+
+
+LFHT_DEFINE_TYPE(item_ht, struct item, item_self, item_keyhash, item_eq);
+
+
+static inline uint64_t xorshift64(uint64_t *state) {
+	uint64_t x = *state;
+	x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+	return *state = x;
+}
+
+
+static inline double rand_unit(uint64_t *state) {
+	return (xorshift64(state) >> 11) * (1.0 / (1ull << 53));
+}
+
+
+static inline uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+
+/* from Gray et al., ``Quickly generating billion-record synthetic databases''
+ * [SIGMOD 1994].
+ */
+static void zipf_init(struct zipf *z, uint64_t n, double theta)
+{
+	double zeta2 = 0;
+	z->n = n;
+	z->theta = theta;
+	z->zetan = 0;
+	for(uint64_t i = 1; i <= n; i++) {
+		z->zetan += 1.0 / pow(i, theta);
+		if(i == 2) zeta2 = z->zetan;
+	}
+	z->alpha = 1.0 / (1.0 - theta);
+	z->eta = (1.0 - pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+}
+
+
+static uint64_t zipf_next(const struct zipf *z, uint64_t *rng)
+{
+	double u = rand_unit(rng), uz = u * z->zetan;
+	if(uz < 1.0) return 0;
+	if(uz < 1.0 + pow(0.5, z->theta)) return 1;
+	uint64_t v = z->n * pow(z->eta * u - z->eta + 1.0, z->alpha);
+	return v < z->n ? v : z->n - 1;
+}
+
+
+/* pick an index in [0, n) according to the configured distribution. the zipf
+ * table is for the whole key space, so it's scaled down for partitions.
+ */
+static size_t pick(struct worker *w, size_t n)
+{
+	switch(w->cfg->dist) {
+		case DIST_UNIFORM: return xorshift64(&w->rng) % n;
+		case DIST_SEQ: return w->seq++ % n;
+		case DIST_ZIPF: {
+			uint64_t v = zipf_next(&w->zipf, &w->rng);
+			/* scatter the popular ranks across the key space so that they
+			 * don't all land in the first partition.
+			 */
+			return (v * 0x9e3779b97f4a7c15ull % w->zipf.n) % n;
+		}
+	}
+	abort();
+}
+
+
+static void lat_push(struct lat_log *l, uint64_t ns)
+{
+	if(l->n == l->cap) {
+		l->cap = l->cap == 0 ? 4096 : l->cap * 2;
+		l->ns = realloc(l->ns, l->cap * sizeof *l->ns);
+		if(l->ns == NULL) abort();
+	}
+	l->ns[l->n++] = ns > UINT32_MAX ? UINT32_MAX : ns;
+}
+
+
+/* find a key in the worker's partition whose presence is @want, starting from
+ * a position picked per distribution. returns -1 if there is none.
+ */
+static ssize_t find_own(struct worker *w, bool want)
+{
+	size_t start = pick(w, w->part_size);
+	for(size_t i = 0; i < w->part_size; i++) {
+		size_t ix = (start + i) % w->part_size;
+		if(w->present[ix] == want) return ix;
+	}
+	return -1;
+}
+
+
+static enum op pick_op(struct worker *w)
+{
+	int r = xorshift64(&w->rng) % 100;
+	if(r < w->cfg->mix[OP_GET]) return OP_GET;
+	else if(r < w->cfg->mix[OP_GET] + w->cfg->mix[OP_ADD]) return OP_ADD;
+	else return OP_DEL;
+}
+
+
+static void get_batch(struct worker *w)
+{
+	const struct config *cfg = w->cfg;
+	for(int i = 0; i < cfg->batch; i++) {
+		struct item *key = &w->items[pick(w, cfg->n_keys)];
+		w->batch_hashes[i] = key->hash;
+		w->batch_keys[i] = key;
+	}
+	int eck = e_begin();
+	w->hits += lfht_get_batch(w->ht, w->batch_hashes, &cmp_item,
+		w->batch_keys, w->batch_out, cfg->batch);
+	e_end(eck);
+}
+
+
+static void *worker_fn(void *param)
+{
+	struct worker *w = param;
+	const struct config *cfg = w->cfg;
+
+	int n = pthread_barrier_wait(&start_bar);
+	if(n != 0 && n != PTHREAD_BARRIER_SERIAL_THREAD) abort();
+
+	for(size_t i = 0; i < cfg->ops; i++) {
+		enum op op = pick_op(w);
+		bool sample = cfg->lat_interval > 0 && i % cfg->lat_interval == 0;
+		uint64_t start = sample ? now_ns() : 0;
+		switch(op) {
+			case OP_GET: {
+				if(cfg->batch > 1) {
+					get_batch(w);
+					if(sample) {
+						uint64_t per = (now_ns() - start) / cfg->batch;
+						for(int j = 0; j < cfg->batch; j++) {
+							lat_push(&w->lat[op], per);
+						}
+					}
+					w->counts[op] += cfg->batch;
+					continue;
+				}
+				struct item *key = &w->items[pick(w, cfg->n_keys)];
+				int eck = e_begin();
+				bool found;
+				if(cfg->ints) found = lfht_int_get(w->ht, key->key);
+				else if(!cfg->typed) {
+					found = lfht_get(w->ht, key->hash, &cmp_item, key) != NULL;
+				} else {
+					found = item_ht_get(container_of(w->ht, struct item_ht, raw),
+						key) != NULL;
+				}
+				if(found) w->hits++;
+				e_end(eck);
+				break;
+			}
+			case OP_ADD: {
+				ssize_t ix = find_own(w, false);
+				if(ix < 0) continue;
+				struct item *it = &w->items[w->part_first + ix];
+				bool ok = cfg->ints ? lfht_int_add(w->ht, it->key)
+					: !cfg->typed ? lfht_add(w->ht, it->hash, it)
+					: item_ht_add(container_of(w->ht, struct item_ht, raw), it);
+				if(!ok) abort();
+				w->present[ix] = true;
+				break;
+			}
+			case OP_DEL: {
+				ssize_t ix = find_own(w, true);
+				if(ix < 0) continue;
+				struct item *it = &w->items[w->part_first + ix];
+				bool ok = cfg->ints ? lfht_int_del(w->ht, it->key)
+					: !cfg->typed ? lfht_del(w->ht, it->hash, it)
+					: item_ht_del(container_of(w->ht, struct item_ht, raw), it);
+				if(!ok) {
+					fprintf(stderr, "%d: del of key %llu failed\n",
+						w->id, (unsigned long long)it->key);
+					abort();
+				}
+				w->present[ix] = false;
+				break;
+			}
+			default: abort();
+		}
+		if(sample) lat_push(&w->lat[op], now_ns() - start);
+		w->counts[op]++;
+	}
+
+	return NULL;
+}
+
+
+static int cmp_u32(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+
+static uint32_t percentile(const uint32_t *sorted, size_t n, double pct) {
+	if(n == 0) return 0;
+	size_t ix = (size_t)(pct / 100.0 * (n - 1) + 0.5);
+	return sorted[ix < n ? ix : n - 1];
+}
+
+
+/* prefill @ht from each partition per the configured fraction. returns the
+ * time taken in nanoseconds.
+ */
+static uint64_t prefill(
+	struct lfht *ht, struct item *items, bool *present,
+	const struct config *cfg, uint64_t *rng)
+{
+	for(size_t i = 0; i < cfg->n_keys; i++) {
+		present[i] = xorshift64(rng) % 100 < cfg->prefill_pct;
+	}
+
+	uint64_t start;
+	if(!cfg->bulk) {
+		start = now_ns();
+		for(size_t i = 0; i < cfg->n_keys; i++) {
+			if(!present[i]) continue;
+			bool ok = cfg->ints ? lfht_int_add(ht, items[i].key)
+				: lfht_add(ht, items[i].hash, &items[i]);
+			if(!ok) abort();
+		}
+	} else {
+		size_t n = 0, *hashes = malloc(cfg->n_keys * sizeof *hashes);
+		void **ptrs = malloc(cfg->n_keys * sizeof *ptrs);
+		if(hashes == NULL || ptrs == NULL) abort();
+		for(size_t i = 0; i < cfg->n_keys; i++) {
+			if(!present[i]) continue;
+			if(cfg->ints) {
+				hashes[n] = lfht_int_hash(items[i].key);
+				ptrs[n++] = lfht_int_ptr(items[i].key);
+			} else {
+				hashes[n] = items[i].hash;
+				ptrs[n++] = &items[i];
+			}
+		}
+		start = now_ns();
+		if(!lfht_add_bulk(ht, hashes, ptrs, n)) abort();
+		free(hashes);
+		free(ptrs);
+	}
+	return now_ns() - start;
+}
+
+
+static void run(const struct config *cfg, int n_threads, struct item *items)
+{
+	struct item_ht tht;
+	struct lfht *ht = &tht.raw;
+	if(cfg->ints) lfht_int_init(ht, cfg->initial_size, cfg->flags);
+	else if(!cfg->typed) {
+		lfht_init_ext(ht, &rehash_item, NULL, cfg->initial_size, cfg->flags);
+	} else {
+		item_ht_init_ext(&tht, cfg->initial_size, cfg->flags);
+	}
+
+	bool *present = calloc(cfg->n_keys, sizeof *present);
+	if(present == NULL) abort();
+	uint64_t rng = cfg->seed | 1;
+	size_t n_prefilled = 0;
+	uint64_t pf_ns = prefill(ht, items, present, cfg, &rng);
+	for(size_t i = 0; i < cfg->n_keys; i++) n_prefilled += present[i];
+	printf("threads=%d prefill: %zu items in %.3f ms (%.2f Mops/s)\n",
+		n_threads, n_prefilled, pf_ns / 1e6,
+		pf_ns > 0 ? n_prefilled * 1e3 / pf_ns : 0.0);
+
+	struct zipf zipf = { .n = cfg->n_keys };
+	if(cfg->dist == DIST_ZIPF) zipf_init(&zipf, cfg->n_keys, cfg->theta);
+
+	struct worker *ws = calloc(n_threads, sizeof *ws);
+	if(ws == NULL) abort();
+	pthread_barrier_init(&start_bar, NULL, n_threads + 1);
+	size_t part = cfg->n_keys / n_threads;
+	for(int i = 0; i < n_threads; i++) {
+		struct worker *w = &ws[i];
+		*w = (struct worker){
+			.id = i, .n_threads = n_threads, .cfg = cfg, .ht = ht,
+			.items = items, .part_first = part * i,
+			.part_size = i == n_threads - 1 ? cfg->n_keys - part * i : part,
+			.rng = (cfg->seed + i * 0x2545f4914f6cdd1dull) | 1,
+			.seq = part * i, .zipf = zipf,
+		};
+		w->present = &present[w->part_first];
+		if(cfg->batch > 1) {
+			w->batch_hashes = malloc(cfg->batch * sizeof *w->batch_hashes);
+			w->batch_keys = malloc(cfg->batch * sizeof *w->batch_keys);
+			w->batch_out = malloc(cfg->batch * sizeof *w->batch_out);
+			if(w->batch_hashes == NULL || w->batch_keys == NULL
+				|| w->batch_out == NULL)
+			{
+				abort();
+			}
+		}
+		int n = pthread_create(&w->thread, NULL, &worker_fn, w);
+		if(n != 0) {
+			fprintf(stderr, "pthread_create failed, n=%d\n", n);
+			abort();
+		}
+	}
+
+	pthread_barrier_wait(&start_bar);
+	uint64_t start = now_ns();
+	for(int i = 0; i < n_threads; i++) pthread_join(ws[i].thread, NULL);
+	uint64_t wall = now_ns() - start;
+
+	size_t total = 0, hits = 0;
+	for(int i = 0; i < n_threads; i++) {
+		for(int op = 0; op < N_OPS; op++) total += ws[i].counts[op];
+		hits += ws[i].hits;
+	}
+	printf("threads=%d total: %zu ops in %.3f ms, %.3f Mops/s\n",
+		n_threads, total, wall / 1e6, total * 1e3 / wall);
+
+	printf("%-8s %-4s %12s %10s %8s %8s %8s\n",
+		"threads", "op", "count", "Mops/s", "p50ns", "p99ns", "p99.9ns");
+	for(int op = 0; op < N_OPS; op++) {
+		size_t count = 0, n_lat = 0;
+		for(int i = 0; i < n_threads; i++) {
+			count += ws[i].counts[op];
+			n_lat += ws[i].lat[op].n;
+		}
+		if(count == 0) continue;
+		uint32_t *all = malloc((n_lat + 1) * sizeof *all);
+		if(all == NULL) abort();
+		for(int i = 0, pos = 0; i < n_threads; i++) {
+			memcpy(&all[pos], ws[i].lat[op].ns,
+				ws[i].lat[op].n * sizeof *all);
+			pos += ws[i].lat[op].n;
+			free(ws[i].lat[op].ns);
+		}
+		qsort(all, n_lat, sizeof *all, &cmp_u32);
+		printf("%-8d %-4s %12zu %10.3f %8u %8u %8u\n",
+			n_threads, op_names[op], count, count * 1e3 / wall,
+			percentile(all, n_lat, 50.0), percentile(all, n_lat, 99.0),
+			percentile(all, n_lat, 99.9));
+		free(all);
+	}
+	if(ws[0].counts[OP_GET] > 0) {
+		size_t gets = 0;
+		for(int i = 0; i < n_threads; i++) gets += ws[i].counts[OP_GET];
+		printf("threads=%d get hit rate: %.1f%%\n",
+			n_threads, 100.0 * hits / gets);
+	}
+
+	for(int i = 0; i < n_threads; i++) {
+		free(ws[i].batch_hashes);
+		free(ws[i].batch_keys);
+		free(ws[i].batch_out);
+	}
+	int eck = e_begin();
+	lfht_clear(ht);
+	e_end(eck);
+	pthread_barrier_destroy(&start_bar);
+	free(ws);
+	free(present);
+}
+
+
+static void usage(const char *prog)
+{
+	fprintf(stderr, "usage: %s [-t threads[,threads...]] [-n keys] "
+		"[-o ops_per_thread]\n"
+		"\t[-p prefill%%] [-r read%%] [-w add%%] [-d del%%] "
+		"[-k uniform|zipf|seq]\n"
+		"\t[-z zipf_theta] [-i initial_size] [-l latency_interval] "
+		"[-S seed] [-b] [-g batch] [-s] [-c] [-C] [-M] [-T] [-I]\n", prog);
+	exit(EXIT_FAILURE);
+}
+
+
+static void parse_threads(struct config *cfg, char *arg)
+{
+	cfg->n_thread_counts = 0;
+	for(char *save = NULL, *tok = strtok_r(arg, ",", &save);
+		tok != NULL && cfg->n_thread_counts < MAX_THREAD_COUNTS;
+		tok = strtok_r(NULL, ",", &save))
+	{
+		int n = atoi(tok);
+		if(n < 1) {
+			fprintf(stderr, "invalid thread count `%s'\n", tok);
+			exit(EXIT_FAILURE);
+		}
+		cfg->thread_counts[cfg->n_thread_counts++] = n;
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	struct config cfg = {
+		.n_keys = 1 << 20, .ops = 1000000, .prefill_pct = 50,
+		.mix = { [OP_GET] = 90, [OP_ADD] = 5, [OP_DEL] = 5 },
+		.dist = DIST_UNIFORM, .theta = 0.99, .lat_interval = 1,
+		.seed = 0x1234abcd,
+	};
+	int n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	for(int n = 1; n <= n_cpus && cfg.n_thread_counts < MAX_THREAD_COUNTS;
+		n *= 2)
+	{
+		cfg.thread_counts[cfg.n_thread_counts++] = n;
+	}
+
+	int opt;
+	while((opt = getopt(argc, argv, "t:n:o:p:r:w:d:k:z:i:l:S:bg:scCMTIh")) != -1) {
+		switch(opt) {
+			case 't': parse_threads(&cfg, optarg); break;
+			case 'n': cfg.n_keys = strtoull(optarg, NULL, 0); break;
+			case 'o': cfg.ops = strtoull(optarg, NULL, 0); break;
+			case 'p': cfg.prefill_pct = atoi(optarg); break;
+			case 'r': cfg.mix[OP_GET] = atoi(optarg); break;
+			case 'w': cfg.mix[OP_ADD] = atoi(optarg); break;
+			case 'd': cfg.mix[OP_DEL] = atoi(optarg); break;
+			case 'z': cfg.theta = atof(optarg); break;
+			case 'i': cfg.initial_size = strtoull(optarg, NULL, 0); break;
+			case 'l': cfg.lat_interval = atoi(optarg); break;
+			case 'S': cfg.seed = strtoul(optarg, NULL, 0); break;
+			case 'b': cfg.bulk = true; break;
+			case 'g': cfg.batch = atoi(optarg); break;
+			case 's': cfg.flags |= LFHT_STORE_HASH; break;
+			case 'c': cfg.flags |= LFHT_CHECK_HASH; break;
+			case 'C': cfg.flags |= LFHT_CTRL_BYTES; break;
+			case 'M': cfg.flags |= LFHT_READ_MIGRATE; break;
+			case 'T': cfg.typed = true; break;
+			case 'I': cfg.ints = true; break;
+			case 'k':
+				if(strcmp(optarg, "uniform") == 0) cfg.dist = DIST_UNIFORM;
+				else if(strcmp(optarg, "zipf") == 0) cfg.dist = DIST_ZIPF;
+				else if(strcmp(optarg, "seq") == 0) cfg.dist = DIST_SEQ;
+				else usage(argv[0]);
+				break;
+			default: usage(argv[0]);
+		}
+	}
+	if(cfg.mix[OP_GET] + cfg.mix[OP_ADD] + cfg.mix[OP_DEL] != 100) {
+		fprintf(stderr, "read/add/del mix must sum to 100\n");
+		return EXIT_FAILURE;
+	}
+	if(cfg.n_keys < 2 || cfg.prefill_pct < 0 || cfg.prefill_pct > 100
+		|| (cfg.dist == DIST_ZIPF && (cfg.theta <= 0 || cfg.theta >= 1))
+		|| (cfg.ints && (cfg.typed || cfg.batch > 1)))
+	{
+		usage(argv[0]);
+	}
+
+	printf("keys=%zu ops/thread=%zu prefill=%d%% mix=%d/%d/%d dist=%s",
+		cfg.n_keys, cfg.ops, cfg.prefill_pct, cfg.mix[OP_GET],
+		cfg.mix[OP_ADD], cfg.mix[OP_DEL], dist_names[cfg.dist]);
+	if(cfg.dist == DIST_ZIPF) printf(" theta=%.2f", cfg.theta);
+	printf(" initial_size=%zu%s", cfg.initial_size, cfg.bulk ? " bulk" : "");
+	if(cfg.batch > 1) printf(" batch=%d", cfg.batch);
+	if(cfg.flags & LFHT_STORE_HASH) printf(" store_hash");
+	if(cfg.flags & LFHT_CHECK_HASH) printf(" check_hash");
+	if(cfg.flags & LFHT_CTRL_BYTES) printf(" ctrl_bytes");
+	if(cfg.flags & LFHT_READ_MIGRATE) printf(" read_migrate");
+	if(cfg.typed) printf(" typed");
+	if(cfg.ints) printf(" ints");
+	printf("\n");
+
+	struct item *items = aligned_alloc(alignof(struct item),
+		cfg.n_keys * sizeof *items);
+	if(items == NULL) abort();
+	for(size_t i = 0; i < cfg.n_keys; i++) {
+		items[i] = (struct item){ .key = i, .hash = item_hash(i) };
+	}
+
+	for(int i = 0; i < cfg.n_thread_counts; i++) {
+		if(cfg.n_keys < cfg.thread_counts[i]) {
+			fprintf(stderr, "fewer keys than threads; skipping %d\n",
+				cfg.thread_counts[i]);
+			continue;
+		}
+		run(&cfg, cfg.thread_counts[i], items);
+	}
+
+	free(items);
+	return EXIT_SUCCESS;
+}
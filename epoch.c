@@ -19,6 +19,7 @@ struct e_client
 {
 	/* thread private */
 	size_t count_since_tick;
+	struct e_dtor_call *spare;		/* records for _e_call_dtor() */
 	/* concurrent access */
 	struct nbsl_node link __attribute__((aligned(64)));
 	_Atomic unsigned long epoch;	/* valid iff active > 0. */
@@ -27,6 +28,7 @@ struct e_client
 
 struct e_dtor_call {
 	struct e_dtor_call *next;
+	struct e_dtor_call *chain;	/* next chain, in the first record of one on reclaim_pending or a free_list */
 	void (*dtor_fn)(void *ptr);
 	void *ptr;
 };
@@ -37,24 +39,106 @@ struct e_dtor_call {
  * [epoch - 1 mod 4] = quiet dtors, possibly under access, late insert
  * [epoch - 2 mod 4] = in-progress dtors (then NULL)
  */
+/* top of a stack of batches; the tag changes with each push and pop, so that a
+ * batch that was popped and pushed back in between fails a pop's CAS.
+ */
+struct e_free_top {
+	struct e_dtor_call *top;
+	uintptr_t tag;
+} __attribute__((aligned(16)));
+
 struct e_bucket {
 	struct e_dtor_call *_Atomic dtor_list[4];
 	_Atomic unsigned count[4];
+	_Atomic struct e_free_top free_list;	/* recycled by tick() */
 } __attribute__((aligned(64)));
 
+/* dtor records are allocated this many at a time, and never returned to the
+ * system allocator; tick() puts them on the bucket's free_list instead, in
+ * batches of up to this many, from where clients take one batch at a time
+ * when their spares run out. so no client holds more than a batch's worth.
+ */
+#define DTOR_SLAB_SIZE 32
+
+/* gathers records into batches for the free list. */
+struct recycler {
+	struct e_bucket *bk;
+	struct e_dtor_call *first, *last;
+	unsigned n;
+};
+
 static _Atomic unsigned long global_epoch = 2;
 static struct percpu *epoch_pc = NULL;
 static struct nbsl client_list = NBSL_LIST_INIT(client_list);
 static once_flag epoch_init_once = ONCE_FLAG_INIT;
 static tss_t client_key;
 
+/* asynchronous and bounded reclamation. tick() pushes quiesced dtor chains
+ * onto reclaim_pending whole, linked through their first records' ->chain,
+ * which the reclaimer thread drains; reclaim_lock and reclaim_cond are for
+ * sleeping and waking it, mode_lock for starting and stopping. in bounded
+ * mode, e_end() runs dtors from reclaim_cursor and the chains after it in
+ * reclaim_chains instead, under cursor_busy, at most reclaim_budget at a time.
+ */
+static _Atomic int reclaim_mode = E_RECLAIM_INLINE;
+static struct e_dtor_call *_Atomic reclaim_pending = NULL;
+static mtx_t reclaim_lock, mode_lock;
+static cnd_t reclaim_cond;
+static thrd_t reclaim_thread;
+static bool reclaim_running = false, reclaim_stop = false;
+static struct e_dtor_call *_Atomic reclaim_cursor = NULL, *_Atomic reclaim_chains = NULL;
+static atomic_flag cursor_busy = ATOMIC_FLAG_INIT;
+static _Atomic unsigned reclaim_budget = 64;
+
 static struct e_bucket *my_bucket(void) { return percpu_my(epoch_pc); }
 
 static void bucket_ctor(void *ptr) { *(struct e_bucket *)ptr = (struct e_bucket){ }; }
 
+/* push the batch of records from @first on into @bk's free list. */
+static void push_batch(struct e_bucket *bk, struct e_dtor_call *first)
+{
+	struct e_free_top old = atomic_load_explicit(&bk->free_list, memory_order_relaxed), new;
+	do {
+		first->chain = old.top;
+		new = (struct e_free_top){ first, old.tag + 1 };
+	} while(!atomic_compare_exchange_weak_explicit(&bk->free_list, &old, new, memory_order_release, memory_order_relaxed));
+}
+
+/* take a batch from @bk's free list, or NULL if there are none. records are
+ * never freed, so reading a popped one's ->chain is harmless; the tag makes
+ * the CAS fail then.
+ */
+static struct e_dtor_call *pop_batch(struct e_bucket *bk)
+{
+	struct e_free_top old = atomic_load_explicit(&bk->free_list, memory_order_acquire), new;
+	do {
+		if(old.top == NULL) return NULL;
+		new = (struct e_free_top){ old.top->chain, old.tag + 1 };
+	} while(!atomic_compare_exchange_weak_explicit(&bk->free_list, &old, new, memory_order_acquire, memory_order_acquire));
+	return old.top;
+}
+
+static void recycle_flush(struct recycler *r)
+{
+	if(r->first != NULL) push_batch(r->bk, r->first);
+	r->first = r->last = NULL;
+	r->n = 0;
+}
+
+/* add @call to @r's batch, pushing it out when full. clobbers @call->next. */
+static void recycle_one(struct recycler *r, struct e_dtor_call *call)
+{
+	call->next = NULL;
+	if(r->first == NULL) r->first = call; else r->last->next = call;
+	r->last = call;
+	if(++r->n == DTOR_SLAB_SIZE) recycle_flush(r);
+}
+
 static void client_dtor(void *priv) {
 	struct e_client *c = priv;
 	assert(c->active == 0);
+	/* (no more than a batch.) */
+	if(c->spare != NULL) push_batch(my_bucket(), c->spare);
 	if(!nbsl_del(&client_list, &c->link)) abort();
 }
 
@@ -62,6 +146,7 @@ static void epoch_init(void) {
 	if(tss_create(&client_key, &client_dtor) != thrd_success) abort();
 	epoch_pc = percpu_new(sizeof(struct e_bucket), &bucket_ctor);
 	if(epoch_pc == NULL) abort(); /* gcc? */
+	if(mtx_init(&reclaim_lock, mtx_plain) != thrd_success || mtx_init(&mode_lock, mtx_plain) != thrd_success || cnd_init(&reclaim_cond) != thrd_success) abort();
 	atomic_thread_fence(memory_order_release);
 }
 
@@ -80,35 +165,174 @@ static struct e_client *get_client(void)
 
 static unsigned long next_epoch(unsigned long e) { return e < ULONG_MAX ? e + 1 : 2; }
 
-/* advance epoch, call quieted dtors */
+/* call dtors from @dead, recycling the records into @bk. returns the number
+ * of dtors called.
+ */
+static unsigned call_dtors(struct e_bucket *bk, struct e_dtor_call *dead)
+{
+	unsigned down = 0;
+	/* call the list in push order, i.e. reverse it first. */
+	struct e_dtor_call *head = NULL;
+	while(dead != NULL) {
+		struct e_dtor_call *next = dead->next;
+		dead->next = head;
+		head = dead; /* saturday mornings, man */
+		dead = next;
+	}
+	struct recycler r = { .bk = bk };
+	while(head != NULL) {
+		struct e_dtor_call *next = head->next;
+		(*head->dtor_fn)(head->ptr);
+		recycle_one(&r, head);
+		head = next;
+		down++;
+	}
+	recycle_flush(&r);
+	return down;
+}
+
+/* push the chain @dead onto reclaim_pending for the reclaimer, as is. */
+static void hand_over(struct e_dtor_call *dead)
+{
+	dead->chain = atomic_load_explicit(&reclaim_pending, memory_order_relaxed);
+	while(!atomic_compare_exchange_weak_explicit(&reclaim_pending, &dead->chain, dead, memory_order_release, memory_order_relaxed)) /* repeat */ ;
+}
+
+static void drain_pending(void)
+{
+	struct e_dtor_call *dead = atomic_exchange_explicit(&reclaim_pending, NULL, memory_order_acquire);
+	while(dead != NULL) {
+		struct e_dtor_call *next = dead->chain;
+		call_dtors(my_bucket(), dead);
+		dead = next;
+	}
+}
+
+/* call at most @budget dtors from reclaim_cursor, going on to the next of
+ * reclaim_chains when it runs out, and refilling those from reclaim_pending.
+ * unlike call_dtors(), calls aren't made in push order, as putting them in
+ * order would cost a walk over each chain. returns false if some other
+ * thread was at it already.
+ */
+static bool drain_bounded(unsigned budget)
+{
+	if(atomic_flag_test_and_set_explicit(&cursor_busy, memory_order_acquire)) return false;
+	struct e_dtor_call *head = atomic_load_explicit(&reclaim_cursor, memory_order_relaxed),
+		*chains = atomic_load_explicit(&reclaim_chains, memory_order_relaxed);
+	struct recycler r = { .bk = my_bucket() };
+	for(unsigned n = 0; n < budget; n++) {
+		if(head == NULL) {
+			if(chains == NULL) chains = atomic_exchange_explicit(&reclaim_pending, NULL, memory_order_acquire);
+			if(chains == NULL) break;
+			head = chains;
+			chains = chains->chain;
+		}
+		struct e_dtor_call *next = head->next;
+		(*head->dtor_fn)(head->ptr);
+		recycle_one(&r, head);
+		head = next;
+	}
+	atomic_store_explicit(&reclaim_cursor, head, memory_order_relaxed);
+	atomic_store_explicit(&reclaim_chains, chains, memory_order_relaxed);
+	atomic_flag_clear_explicit(&cursor_busy, memory_order_release);
+	recycle_flush(&r);
+	return true;
+}
+
+static inline bool have_cursor(void) {
+	return atomic_load_explicit(&reclaim_cursor, memory_order_relaxed) != NULL || atomic_load_explicit(&reclaim_chains, memory_order_relaxed) != NULL;
+}
+
+static inline bool have_leftovers(void) {
+	return atomic_load_explicit(&reclaim_pending, memory_order_relaxed) != NULL || have_cursor();
+}
+
+/* advance epoch, call quieted dtors or hand them over to the reclaimer or
+ * budgeted e_end() calls.
+ */
 static void tick(unsigned long old_epoch)
 {
 	unsigned long oldval = old_epoch, new_epoch = next_epoch(old_epoch);
 	atomic_compare_exchange_strong_explicit(&global_epoch, &oldval, new_epoch, memory_order_release, memory_order_relaxed);
-	int gone = (old_epoch - 2) & 3;
+	int gone = (old_epoch - 2) & 3, mode = atomic_load_explicit(&reclaim_mode, memory_order_relaxed);
+	bool handed = false;
 	for(int i = 0, base = sched_getcpu() >> epoch_pc->shift; i < epoch_pc->n_buckets; i++) {
 		struct e_bucket *bk = percpu_get(epoch_pc, base ^ i);
 		struct e_dtor_call *dead = atomic_exchange_explicit(&bk->dtor_list[gone], NULL, memory_order_acquire);
-		unsigned down = 0;
-		/* call the list in push order, i.e. reverse it first. */
-		struct e_dtor_call *head = NULL;
-		while(dead != NULL) {
-			struct e_dtor_call *next = dead->next;
-			dead->next = head;
-			head = dead; /* saturday mornings, man */
-			dead = next;
-		}
-		while(head != NULL) {
-			(*head->dtor_fn)(head->ptr);
-			struct e_dtor_call *next = head->next;
-			free(head);
-			head = next;
-			down++;
+		unsigned down;
+		if(mode == E_RECLAIM_INLINE || dead == NULL) down = call_dtors(bk, dead);
+		else {
+			/* the count stands for the chain's length, which'd cost a walk. */
+			hand_over(dead);
+			handed = true;
+			down = atomic_load_explicit(&bk->count[gone], memory_order_relaxed);
 		}
 		atomic_fetch_sub_explicit(&bk->count[gone], down, memory_order_release);
 	}
+	if(handed && mode == E_RECLAIM_ASYNC) {
+		mtx_lock(&reclaim_lock);
+		cnd_signal(&reclaim_cond);
+		mtx_unlock(&reclaim_lock);
+	} else if(mode == E_RECLAIM_INLINE && unlikely(have_leftovers())) {
+		/* left over from a switch to inline mode. */
+		drain_bounded(UINT_MAX);
+	}
+}
+
+static int reclaim_fn(void *unused)
+{
+	mtx_lock(&reclaim_lock);
+	for(;;) {
+		while(atomic_load_explicit(&reclaim_pending, memory_order_relaxed) == NULL && !reclaim_stop) cnd_wait(&reclaim_cond, &reclaim_lock);
+		if(atomic_load_explicit(&reclaim_pending, memory_order_relaxed) == NULL) break; /* stopped & drained */
+		mtx_unlock(&reclaim_lock);
+		drain_pending();
+		/* left over from a switch out of bounded mode. */
+		if(have_cursor()) drain_bounded(UINT_MAX);
+		mtx_lock(&reclaim_lock);
+	}
+	mtx_unlock(&reclaim_lock);
+	return 0;
 }
 
+int e_set_reclaim_mode(int mode)
+{
+	if(mode != E_RECLAIM_INLINE && mode != E_RECLAIM_ASYNC && mode != E_RECLAIM_BOUNDED) return -EINVAL;
+	call_once(&epoch_init_once, &epoch_init);
+	mtx_lock(&mode_lock);
+	int old = atomic_load_explicit(&reclaim_mode, memory_order_relaxed);
+	if(mode == E_RECLAIM_ASYNC && !reclaim_running) {
+		reclaim_stop = false;
+		if(thrd_create(&reclaim_thread, &reclaim_fn, NULL) != thrd_success) {
+			mtx_unlock(&mode_lock);
+			return -EAGAIN;
+		}
+		reclaim_running = true;
+	}
+	atomic_store_explicit(&reclaim_mode, mode, memory_order_relaxed);
+	if(mode != E_RECLAIM_ASYNC && reclaim_running) {
+		mtx_lock(&reclaim_lock);
+		reclaim_stop = true;
+		cnd_signal(&reclaim_cond);
+		mtx_unlock(&reclaim_lock);
+		thrd_join(reclaim_thread, NULL);
+		reclaim_running = false;
+	}
+	if(old == E_RECLAIM_BOUNDED && mode != E_RECLAIM_BOUNDED) {
+		/* run what was left for budgeted e_end() calls. */
+		while(!drain_bounded(UINT_MAX)) sched_yield();
+	} else if(mode == E_RECLAIM_INLINE) {
+		/* pick up what a concurrent tick() may have handed over late. */
+		drain_pending();
+	}
+	mtx_unlock(&mode_lock);
+	return 0;
+}
+
+void e_set_reclaim_budget(unsigned budget) { atomic_store_explicit(&reclaim_budget, budget > 0 ? budget : 1, memory_order_relaxed); }
+
+int e_get_reclaim_mode(void) { return atomic_load_explicit(&reclaim_mode, memory_order_relaxed); }
+
 static inline int make_cookie(unsigned long epoch, bool nested) {
 	/* avoid overflowing a signed int. */
 	return ((epoch & 0x3fffffff) << 1) | (nested ? 1 : 0);
@@ -160,6 +384,9 @@ void e_end(int cookie)
 		unsigned long epoch = atomic_load_explicit(&global_epoch, memory_order_acquire);
 		assert(epoch == c->epoch || epoch == next_epoch(c->epoch));
 		if(my_bucket()->count[epoch & 3] > 0 || (deep && sum_counts(epoch & 3) > 0)) maybe_tick(epoch, c);
+		if(atomic_load_explicit(&reclaim_mode, memory_order_relaxed) == E_RECLAIM_BOUNDED && have_leftovers()) {
+			drain_bounded(atomic_load_explicit(&reclaim_budget, memory_order_relaxed));
+		}
 	}
 	old_active = atomic_fetch_sub_explicit(&c->active, 1, memory_order_release);
 	assert(old_active > 0 && (old_active > 1 || (~cookie & 1)));
@@ -180,11 +407,24 @@ int e_resume(int cookie)
 	}
 }
 
+static struct e_dtor_call *new_call(struct e_client *c)
+{
+	struct e_dtor_call *call = c->spare;
+	if(unlikely(call == NULL)) {
+		call = pop_batch(my_bucket());
+		if(call == NULL) {
+			if(call = malloc(DTOR_SLAB_SIZE * sizeof *call), call == NULL) abort();
+			for(int i = 0; i < DTOR_SLAB_SIZE - 1; i++) call[i].next = &call[i + 1];
+			call[DTOR_SLAB_SIZE - 1].next = NULL;
+		}
+	}
+	c->spare = call->next;
+	return call;
+}
+
 void _e_call_dtor(void (*dtor_fn)(void *ptr), void *ptr)
 {
-	if(unlikely(epoch_pc == NULL)) call_once(&epoch_init_once, &epoch_init);
-	struct e_dtor_call *call = malloc(sizeof *call);
-	if(call == NULL) abort();
+	struct e_dtor_call *call = new_call(get_client());
 	*call = (struct e_dtor_call){ .dtor_fn = dtor_fn, .ptr = ptr };
 	struct e_bucket *bk = my_bucket();
 	unsigned long epoch = atomic_load_explicit(&global_epoch, memory_order_relaxed);
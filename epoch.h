@@ -40,4 +40,29 @@ extern void _e_call_dtor(void (*dtor_fn)(void *), void *ptr);
 /* wrapper of e_call_dtor(&free, @ptr). */
 extern void e_free(void *ptr);
 
+/* where quiesced dtors get called. in E_RECLAIM_INLINE, the default, they're
+ * called by whichever thread's e_end() advances the epoch. in
+ * E_RECLAIM_ASYNC, that e_end() only hands them over to a background thread,
+ * which is started by the switch to async and joined by the switch away.
+ * dtors may then run concurrently with any client, so they must not rely on
+ * running in the thread that called e_end(). in E_RECLAIM_BOUNDED, each
+ * outermost e_end() calls at most as many dtors as set with
+ * e_set_reclaim_budget() (default 64), and leaves the rest for the next; the
+ * epoch keeps advancing regardless. the order in which dtors are called is
+ * unspecified in bounded mode.
+ *
+ * switching out of bounded mode calls the remaining dtors before returning.
+ * returns 0 on success, -EINVAL for an unknown @mode, and -EAGAIN when the
+ * reclaimer thread couldn't be started.
+ */
+#define E_RECLAIM_INLINE 0
+#define E_RECLAIM_ASYNC 1
+#define E_RECLAIM_BOUNDED 2
+
+extern int e_set_reclaim_mode(int mode);
+extern int e_get_reclaim_mode(void);
+
+/* a @budget of 0 is taken as 1. */
+extern void e_set_reclaim_budget(unsigned budget);
+
 #endif
@@ -10,6 +10,7 @@
 #include <inttypes.h>
 #include <assert.h>
 #include <sched.h>
+#include <threads.h>
 #include <errno.h>
 
 #include <ccan/likely/likely.h>
@@ -20,6 +21,7 @@
 
 
 #define MIN_SIZE_LOG2 LFHT_MIN_TABLE_SIZE
+#define MIN_COMMON_BITS 6	/* five reserved, and one for hash bits */
 #define MIN_PROBE (64 * 2 / sizeof(uintptr_t))
 
 #define POPCOUNT(x) __builtin_popcountl((x))
@@ -29,6 +31,23 @@
 #define ELEMS(t) (MY_PERCPU((t))->elems)
 #define DELETED(t) (MY_PERCPU((t))->deleted)
 
+#ifdef LFHT_PROBE_HIST
+/* the per-CPU counters with the probe length histogram tacked on, so that
+ * the layout of the public structure doesn't depend on the build.
+ */
+struct table_percpu_hist
+{
+	struct lfht_table_percpu c;
+	_Atomic size_t probe_hist[LFHT_PROBE_N_KINDS][LFHT_PROBE_HIST_BUCKETS]
+		__attribute__((aligned(64)));
+};
+
+#define PERCPU_SIZE sizeof(struct table_percpu_hist)
+#define PROBE_HIST_OF(pc) (((struct table_percpu_hist *)(pc))->probe_hist)
+#else
+#define PERCPU_SIZE sizeof(struct lfht_table_percpu)
+#endif
+
 
 #define increase_to(ptr, val) do { \
 		typeof((val)) _v = (val); \
@@ -41,6 +60,8 @@
 
 static struct lfht_table *next_table_gen(
 	struct lfht *ht, struct lfht_table *prev, bool filter_halted);
+static struct lfht_table *get_oldest(struct lfht *ht);
+static void migrator_kick(struct lfht *ht);
 
 
 #ifndef NDEBUG
@@ -66,6 +87,21 @@ static int size_to_log2(size_t s) {
 }
 
 
+/* the hash that positions and match bits in @t are derived from, given the
+ * one passed in by the caller. that's the same unless lfht_rehash() gave @t
+ * a seed, in which case it's a bijective scramble of the two.
+ */
+static inline size_t table_hash(const struct lfht_table *t, size_t hash)
+{
+	if(likely(t->seed == 0)) return hash;
+	uint64_t x = ((uint64_t)hash ^ t->seed) * 0x9e3779b97f4a7c15ull;
+	x ^= x >> 29;
+	x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 32;
+	return (size_t)x;
+}
+
+
 /* true if @e (from @t->table) terminates probing. */
 static inline bool is_void(const struct lfht_table *t, uintptr_t e) {
 	return (e & ~t->mig_bit) == 0;
@@ -123,6 +159,7 @@ static inline size_t mig_slot(
 	uintptr_t addr = e >> 10;
 
 	/* combine hash, overflow bit, and the position in @e. */
+	hash = table_hash(dst, hash);
 	uintptr_t dst_mask = (1ul << dst->size_log2) - 1,
 		bit = 1ul << dst->probe_addr_size_log2,
 		slot = (addr & ~bit) | ((hash + (addr & bit)) & ~(bit - 1) & dst_mask);
@@ -144,6 +181,7 @@ static inline uintptr_t probe_addr(
 	size_t dpos, size_t hash, struct lfht_table *dst)
 {
 	uintptr_t bit = 1ul << dst->probe_addr_size_log2;
+	hash = table_hash(dst, hash);
 	return ((dpos & bit) != (hash & bit) ? bit : 0) | (dpos & (bit - 1));
 }
 
@@ -214,28 +252,53 @@ static inline uintptr_t take_bit(uintptr_t *set)
 static void set_resv_bits(struct lfht_table *tab)
 {
 	uintptr_t cm = tab->common_mask;
-	if(likely(POPCOUNT(cm) >= 5)) {
+	if(likely(POPCOUNT(cm) >= MIN_COMMON_BITS)) {
 		tab->ephem_bit = take_bit(&cm);
 		tab->src_bit = take_bit(&cm);
 		tab->del_bit = take_bit(&cm);
 		tab->mig_bit = take_bit(&cm);
 		tab->hazard_bit = take_bit(&cm);
 	} else {
-		/* FIXME: the ugly fix for this involves making up all new common_mask
-		 * and common_bits, for an equal-sized main table as the previous, but
-		 * with 5 or 6 bits to spare. this'd use allocated storage to keep
-		 * combinations of keys that have no common bits, and require some
-		 * adjustments to the migration algorithm. so for now let's leave it
-		 * in a "tests don't hit it" condition.
+		/* callers check can_remask() first, and items that'd bring us here
+		 * go to the escape table instead.
 		 */
-		assert("migration requires 5 special bits (FIXME)" == NULL);
+		assert("migration requires 5 special bits and a hash bit" == NULL);
 	}
-	tab->perfect_bit = cm != 0 ? take_bit(&cm) : 0;
+	/* get_hash_ptr_bits() needs at least one. */
+	tab->perfect_bit = POPCOUNT(cm) >= 2 ? take_bit(&cm) : 0;
 	tab->resv_mask = tab->perfect_bit | tab->ephem_bit | tab->src_bit
 		| tab->del_bit | tab->mig_bit | tab->hazard_bit;
 }
 
 
+/* reduce @tab's common_mask and common_bits so that @model conforms. returns
+ * true if they changed, in which case the reserved bits must be recomputed.
+ */
+static bool reduce_common(struct lfht_table *tab, const void *model)
+{
+	uintptr_t m = (uintptr_t)model;
+	if((m & tab->common_mask) == tab->common_bits) return false;
+
+	uintptr_t new = tab->common_bits ^ (m & tab->common_mask);
+	assert((new & tab->common_mask) != 0);
+	tab->common_mask &= ~new;
+	tab->common_bits &= ~new;
+	assert((m & tab->common_mask) == tab->common_bits);
+	return true;
+}
+
+
+/* true if @p can be made to conform to @t's common bits by a remask that'd
+ * leave enough bits for set_resv_bits().
+ */
+static bool can_remask(const struct lfht_table *t, const void *p)
+{
+	uintptr_t m = t->common_mask
+		& ~(t->common_bits ^ ((uintptr_t)p & t->common_mask));
+	return POPCOUNT(m) >= MIN_COMMON_BITS;
+}
+
+
 static void set_bits(
 	int first_size_log2,
 	struct lfht_table *tab, const struct lfht_table *prev,
@@ -256,14 +319,8 @@ static void set_bits(
 		tab->common_mask = prev->common_mask;
 		tab->common_bits = prev->common_bits;
 
-		uintptr_t m = (uintptr_t)model;
-		if(model != NULL && (m & tab->common_mask) != tab->common_bits) {
-			/* reduce common_mask, recompute reserved bits. */
-			uintptr_t new = tab->common_bits ^ (m & tab->common_mask);
-			assert((new & tab->common_mask) != 0);
-			tab->common_mask &= ~new;
-			tab->common_bits &= ~new;
-			assert((m & tab->common_mask) == tab->common_bits);
+		if(model != NULL && reduce_common(tab, model)) {
+			/* recompute reserved bits. */
 			set_resv_bits(tab);
 		} else {
 			/* inherit reserved bits. */
@@ -330,13 +387,39 @@ static inline size_t get_total_mig_left(struct lfht_table *t) {
 }
 
 
+/* per-block summaries of migration, a 16-bit word for each block of
+ * 1 << MIG_BLOCK_LOG2 slots. the low bits count the block's slots that
+ * migration has been through; whoever counts off the last one checks that
+ * every slot has mig_bit set, which is final, and sets MIG_BLOCK_DONE along
+ * with the offset of the block's last void, if any. ht_val() then steps over
+ * the block without reading any of it, except that a probe which comes in at
+ * or before that void ends there as it would've on the slot itself. the main
+ * table's summaries are never set.
+ */
+#define MIG_BLOCK_LOG2 6
+#define MIG_BLOCK_COUNT 0x7f
+#define MIG_BLOCK_VOID_SHIFT 8
+#define MIG_BLOCK_HAS_VOID 0x4000
+#define MIG_BLOCK_DONE 0x8000
+
+/* slots that migration takes from a per-CPU chunk per CAS on mig_next. one
+ * cacheline's worth on LP64.
+ */
+#define MIG_CLAIM LFHT_MIG_CLAIM
+
+
+static inline size_t mig_done_words(int sizelog2) {
+	return ((1ul << sizelog2) + (1ul << MIG_BLOCK_LOG2) - 1) >> MIG_BLOCK_LOG2;
+}
+
+
 /* FIXME: handle the case where gen_id wraps around by compressing gen_ids
  * from far up. this is rather unlikely to matter for now, but is absolutely
  * critical for multi-year stability, since rehashing will continue
  * indefinitely in a lfht under load. (this comment is here because setting
  * gen_id happens at the new_table() callsites, which are several.)
  */
-static struct lfht_table *new_table(int sizelog2)
+static struct lfht_table *new_table(const struct lfht *ht, int sizelog2)
 {
 	assert(sizelog2 >= MIN_SIZE_LOG2);
 	struct lfht_table *tab = aligned_alloc(
@@ -344,14 +427,51 @@ static struct lfht_table *new_table(int sizelog2)
 	if(tab == NULL) return NULL;
 	tab->link.next = 0;
 	tab->size_log2 = sizelog2;
+	tab->keep_log2 = 0;
 	tab->gen_id = 0;
+	tab->halt_gen_id = 0;
+	tab->seed = atomic_load_explicit(&ht->seed, memory_order_relaxed);
 	tab->table = calloc(1L << sizelog2, sizeof(uintptr_t));
 	if(tab->table == NULL) {
 		free(tab);
 		return NULL;
 	}
-	tab->pc = percpu_new(sizeof(struct lfht_table_percpu), NULL);
+	tab->hashes = NULL;
+	if((ht->flags & (LFHT_STORE_HASH | LFHT_CHECK_HASH)) != 0) {
+		tab->hashes = aligned_alloc(alignof(struct lfht_hash_pair),
+			sizeof(struct lfht_hash_pair) << sizelog2);
+		if(tab->hashes == NULL) {
+			free(tab->table);
+			free(tab);
+			return NULL;
+		}
+		/* (ptr=0 matches no entry.) */
+		memset((void *)tab->hashes, 0,
+			sizeof(struct lfht_hash_pair) << sizelog2);
+	}
+	tab->mig_done = calloc(mig_done_words(sizelog2), sizeof(uint16_t));
+	if(tab->mig_done == NULL) {
+		free((void *)tab->hashes);
+		free(tab->table);
+		free(tab);
+		return NULL;
+	}
+	tab->ctrl = NULL;
+	if((ht->flags & LFHT_CTRL_BYTES) != 0) {
+		tab->ctrl = calloc(1L << sizelog2, sizeof(uint8_t));
+		if(tab->ctrl == NULL) {
+			free((void *)tab->mig_done);
+			free((void *)tab->hashes);
+			free(tab->table);
+			free(tab);
+			return NULL;
+		}
+	}
+	tab->pc = percpu_new(PERCPU_SIZE, NULL);
 	if(tab->pc == NULL) {
+		free((void *)tab->ctrl);
+		free((void *)tab->mig_done);
+		free((void *)tab->hashes);
 		free(tab->table);
 		free(tab);
 		return NULL;
@@ -396,6 +516,30 @@ static struct lfht_table *new_table(int sizelog2)
 }
 
 
+/* discard a table that was never installed in a lfht. */
+static void drop_table(struct lfht_table *tab)
+{
+	percpu_free(tab->pc);
+	free((void *)tab->ctrl);
+	free((void *)tab->mig_done);
+	free((void *)tab->hashes);
+	free(tab->table);
+	free(tab);
+}
+
+
+/* installs @nt over @tab, the main table, and has the migrator (if any)
+ * start on @tab. false if @tab was no longer the main table.
+ */
+static bool push_main(
+	struct lfht *ht, struct lfht_table *tab, struct lfht_table *nt)
+{
+	if(!nbsl_push(&ht->tables, &tab->link, &nt->link)) return false;
+	migrator_kick(ht);
+	return true;
+}
+
+
 /* try to install a new main table until the main table's common mask & bits
  * accommodate @model. returns NULL on malloc() failure.
  */
@@ -404,29 +548,31 @@ static struct lfht_table *remask_table(
 {
 	assert(model != NULL);
 
-	struct lfht_table *nt = new_table(tab->size_log2);
+	struct lfht_table *nt = new_table(ht, tab->size_log2);
 	if(nt == NULL) return NULL;
 
 	for(;;) {
 		set_bits(0, nt, tab, model);
 		nt->gen_id = tab->gen_id + 1;
-		if(nbsl_push(&ht->tables, &tab->link, &nt->link)) {
+		nt->keep_log2 = tab->keep_log2;
+		if(push_main(ht, tab, nt)) {
 			/* i won! i won! */
 			return nt;
 		}
 		tab = get_main(ht);
-		if(((uintptr_t)model & tab->common_mask) == tab->common_bits) {
+		if(((uintptr_t)model & tab->common_mask) == tab->common_bits
+			|| !can_remask(tab, model))
+		{
 			/* concurrently replaced with a conforming table, superceding
-			 * ours.
+			 * ours; or with one that @model would exhaust, so it must
+			 * escape.
 			 */
-			free(nt->table);
-			free(nt);
+			drop_table(nt);
 			return tab;
 		} else if(tab->size_log2 > nt->size_log2) {
 			/* concurrently doubled. reallocate ours & retry. */
-			free(nt->table);
-			free(nt);
-			nt = new_table(tab->size_log2);
+			drop_table(nt);
+			nt = new_table(ht, tab->size_log2);
 			if(nt == NULL) return NULL;
 		} else {
 			/* concurrent remask or rehash. retry w/ same new table. */
@@ -435,32 +581,36 @@ static struct lfht_table *remask_table(
 }
 
 
-/* install a new table, twice the size of @tab, in @ht. if malloc fails,
- * return NULL. if replacement fails, and the new one is larger than @tab,
- * return that; if it's not larger, redo with that instead of @tab.
+/* install a new table of 1 << @sizelog2 slots, larger than @tab, in @ht,
+ * that won't be shrunk below 1 << @keep_log2. if malloc fails, return NULL.
+ * if replacement fails, and the new main table is at least as large, return
+ * that; if it's not, redo with that instead of @tab.
  */
-static struct lfht_table *double_table(
-	struct lfht *ht, struct lfht_table *tab, void *model)
+static struct lfht_table *grow_table(
+	struct lfht *ht, struct lfht_table *tab, int sizelog2, int keep_log2,
+	void *model)
 {
-	struct lfht_table *nt = new_table(tab->size_log2 + 1);
+	assert(sizelog2 > tab->size_log2);
+	struct lfht_table *nt = new_table(ht, sizelog2);
 	if(nt == NULL) return NULL;
+	nt->keep_log2 = keep_log2;
 
 	for(;;) {
 		set_bits(0, nt, tab, model);
 		nt->gen_id = tab->gen_id + 1;
-		if(nbsl_push(&ht->tables, &tab->link, &nt->link)) return nt;
+		if(push_main(ht, tab, nt)) return nt;
 		tab = get_main(ht);
 		if(tab->size_log2 >= nt->size_log2) {
 			/* resized by another thread. */
-			free(nt->table);
-			free(nt);
+			drop_table(nt);
 			break;
 		}
 		/* was replaced by rehash. doubling remains appropriate. */
 	}
 
 	if(model != NULL
-		&& ((uintptr_t)model & tab->common_mask) != tab->common_bits)
+		&& ((uintptr_t)model & tab->common_mask) != tab->common_bits
+		&& can_remask(tab, model))
 	{
 		/* replace it w/ same size, but conformant. */
 		return remask_table(ht, tab, model);
@@ -471,33 +621,49 @@ static struct lfht_table *double_table(
 }
 
 
-/* install a new table of exactly the same size. lfht_add() will migrate two
- * items at a time while the new table remains @ht's main table. if malloc
- * fails, return @tab; if switching fails, return the new table.
+/* install a new table, twice the size of @tab, in @ht. */
+static struct lfht_table *double_table(
+	struct lfht *ht, struct lfht_table *tab, void *model)
+{
+	return grow_table(ht, tab, tab->size_log2 + 1, 0, model);
+}
+
+
+/* install a new table of 1 << @sizelog2 slots. lfht_add() will migrate three
+ * items at a time, or more when @tab is larger, while the new table remains
+ * @ht's main table. if malloc fails, return @tab; if switching fails, return
+ * the new main table.
  */
-static struct lfht_table *rehash_table(
-	struct lfht *ht, struct lfht_table *tab)
+static struct lfht_table *resize_table(
+	struct lfht *ht, struct lfht_table *tab, int sizelog2)
 {
-	struct lfht_table *nt = new_table(tab->size_log2);
+	assert(sizelog2 >= MIN_SIZE_LOG2);
+	struct lfht_table *nt = new_table(ht, sizelog2);
 	if(nt == NULL) return tab;
 	set_bits(0, nt, tab, NULL);
 	nt->gen_id = tab->gen_id + 1;
-	if(nbsl_push(&ht->tables, &tab->link, &nt->link)) tab = nt;
+	if(sizelog2 == tab->size_log2) nt->keep_log2 = tab->keep_log2;
+	if(push_main(ht, tab, nt)) tab = nt;
 	else {
-		free(nt->table);
-		free(nt);
+		drop_table(nt);
 		tab = get_main(ht);
 	}
 	return tab;
 }
 
 
+/* install a new table of exactly the same size. */
+static struct lfht_table *rehash_table(
+	struct lfht *ht, struct lfht_table *tab)
+{
+	return resize_table(ht, tab, tab->size_log2);
+}
+
+
 static void table_dtor(struct lfht_table *tab)
 {
 	assert(get_total_elems(tab) == 0);
-	percpu_free(tab->pc);
-	free(tab->table);
-	free(tab);
+	drop_table(tab);
 }
 
 
@@ -526,8 +692,13 @@ static inline uintptr_t get_hash_ptr_bits(
 	 * right, whereas CCAN does a simple shift.
 	 */
 	int n = tab->size_log2 + 4;
-	return (hash ^ ((hash >> n) | (hash << (sizeof(hash) * 8 - n))))
-		& tab->common_mask & ~tab->resv_mask;
+	hash = table_hash(tab, hash);
+	uintptr_t hm = tab->common_mask & ~tab->resv_mask,
+		bits = (hash ^ ((hash >> n) | (hash << (sizeof(hash) * 8 - n)))) & hm;
+	/* never none, so that an item whose pointer is just the common bits
+	 * doesn't make a void entry away from its home slot.
+	 */
+	return bits != 0 ? bits : hm & -hm;
 }
 
 
@@ -543,13 +714,306 @@ static inline void *get_raw_ptr(const struct lfht_table *tab, uintptr_t e) {
 }
 
 
+/* vectorized skipping over uninteresting slots in ht_val() and ht_add(). a
+ * slot is interesting when (e & zmask) == 0, or when (e & emask) == eq; the
+ * scalar loops decide what's actually done with it. lanes are read with
+ * plain vector loads, which doesn't tear the 8-byte aligned slots on x86-64;
+ * anything found is re-read with an atomic load by the caller, so a stale
+ * skip is no different from the scalar loop having read the slot earlier.
+ *
+ * define LFHT_NO_SIMD to keep the scalar loops only.
+ */
+#if defined(__x86_64__) && !defined(LFHT_NO_SIMD)
+#define LFHT_SIMD 1
+#include <immintrin.h>
+
+/* returns index of the first interesting slot in @s[0..n), or @n if none. */
+static size_t scan_sse2(
+	const _Atomic uintptr_t *s, size_t n,
+	uintptr_t zmask, uintptr_t emask, uintptr_t eq)
+{
+	const __m128i vz = _mm_set1_epi64x(zmask), ve = _mm_set1_epi64x(emask),
+		veq = _mm_set1_epi64x(eq), zero = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 2 <= n; i += 2) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&s[i]),
+			a = _mm_cmpeq_epi32(_mm_and_si128(x, vz), zero),
+			b = _mm_cmpeq_epi32(_mm_and_si128(x, ve), veq);
+		/* no 64-bit compare in SSE2; both halves must be equal. */
+		a = _mm_and_si128(a, _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 3, 0, 1)));
+		b = _mm_and_si128(b, _mm_shuffle_epi32(b, _MM_SHUFFLE(2, 3, 0, 1)));
+		int m = _mm_movemask_pd(_mm_castsi128_pd(_mm_or_si128(a, b)));
+		if(m != 0) return i + __builtin_ctz(m);
+	}
+	if(i < n) {
+		uintptr_t e = atomic_load_explicit(&s[i], memory_order_relaxed);
+		if((e & zmask) != 0 && (e & emask) != eq) i++;
+	}
+	return i;
+}
+
+
+__attribute__((target("avx2")))
+static size_t scan_avx2(
+	const _Atomic uintptr_t *s, size_t n,
+	uintptr_t zmask, uintptr_t emask, uintptr_t eq)
+{
+	const __m256i vz = _mm256_set1_epi64x(zmask),
+		ve = _mm256_set1_epi64x(emask), veq = _mm256_set1_epi64x(eq),
+		zero = _mm256_setzero_si256();
+	size_t i = 0;
+	/* a cache line's worth at a time. */
+	for(; i + 8 <= n; i += 8) {
+		__m256i x0 = _mm256_loadu_si256((const __m256i *)&s[i]),
+			x1 = _mm256_loadu_si256((const __m256i *)&s[i + 4]),
+			m0 = _mm256_or_si256(
+				_mm256_cmpeq_epi64(_mm256_and_si256(x0, vz), zero),
+				_mm256_cmpeq_epi64(_mm256_and_si256(x0, ve), veq)),
+			m1 = _mm256_or_si256(
+				_mm256_cmpeq_epi64(_mm256_and_si256(x1, vz), zero),
+				_mm256_cmpeq_epi64(_mm256_and_si256(x1, ve), veq));
+		int m = _mm256_movemask_pd(_mm256_castsi256_pd(m0))
+			| _mm256_movemask_pd(_mm256_castsi256_pd(m1)) << 4;
+		if(m != 0) return i + __builtin_ctz(m);
+	}
+	for(; i < n; i++) {
+		uintptr_t e = atomic_load_explicit(&s[i], memory_order_relaxed);
+		if((e & zmask) == 0 || (e & emask) == eq) break;
+	}
+	return i;
+}
+
+
+static inline size_t scan_slots(
+	const _Atomic uintptr_t *s, size_t n,
+	uintptr_t zmask, uintptr_t emask, uintptr_t eq)
+{
+	if(__builtin_cpu_supports("avx2")) {
+		return scan_avx2(s, n, zmask, emask, eq);
+	} else {
+		return scan_sse2(s, n, zmask, emask, eq);
+	}
+}
+#endif
+
+
+/* advance from @off towards @end (exclusive, wrapping around @t's end) to
+ * the first interesting slot as defined above. returns @end if there were
+ * none, or if @off == @end. without LFHT_SIMD, returns @off as-is.
+ */
+static inline size_t probe_skip(
+	const struct lfht_table *t, size_t off, size_t end,
+	uintptr_t zmask, uintptr_t emask, uintptr_t eq)
+{
+#ifdef LFHT_SIMD
+	if(off == end) return end;
+	size_t lim = end > off ? end : 1ul << t->size_log2,
+		n = scan_slots(&t->table[off], lim - off, zmask, emask, eq);
+	if(off + n < lim || lim == end) return off + n;
+	return scan_slots(&t->table[0], end, zmask, emask, eq);
+#else
+	return off;
+#endif
+}
+
+
+#ifdef LFHT_PROBE_HIST
+static void probe_hist_add(
+	struct lfht_table *t, int kind, size_t hash, size_t pos)
+{
+	size_t dist = (pos - table_hash(t, hash)) & ((1ul << t->size_log2) - 1);
+	int b = dist == 0 ? 0 : MSB(dist) + 1;
+	if(b >= LFHT_PROBE_HIST_BUCKETS) b = LFHT_PROBE_HIST_BUCKETS - 1;
+	atomic_fetch_add_explicit(&PROBE_HIST_OF(MY_PERCPU(t))[kind][b], 1,
+		memory_order_relaxed);
+}
+#define PROBE_HIST(t, kind, hash, pos) \
+	probe_hist_add((t), (kind), (hash), (pos))
+#else
+#define PROBE_HIST(t, kind, hash, pos) do { } while(false)
+#endif
+
+
+/* control bytes under LFHT_CTRL_BYTES. each slot has one, which is zero
+ * until something is first written into the slot, and then either a tag
+ * derived from the hash of what was written, or CTRL_ANY once entries of
+ * different tags have used the slot. it's set before the entry is published,
+ * so a control byte that's neither zero, CTRL_ANY, nor the tag of a given
+ * hash designates a slot that can't hold an entry for that hash.
+ */
+#define CTRL_ANY 0xff
+
+
+static inline uint8_t ctrl_tag(size_t hash)
+{
+	uint8_t t = (hash >> (sizeof(hash) * 8 - 7)) & 0x7f;
+	return 0x80 | (t == 0x7f ? 0x7e : t);
+}
+
+
+static void ctrl_mark(struct lfht_table *t, size_t pos, uint8_t tag)
+{
+	uint8_t c = atomic_load_explicit(&t->ctrl[pos], memory_order_relaxed);
+	while(c != tag && c != CTRL_ANY
+		&& !atomic_compare_exchange_weak_explicit(&t->ctrl[pos], &c,
+			c == 0 ? tag : CTRL_ANY,
+			memory_order_relaxed, memory_order_relaxed))
+	{
+		/* again */
+	}
+}
+
+
+/* returns index of the first control byte in @c[0..n) that's zero, @tag, or
+ * CTRL_ANY; or @n if there are none.
+ */
+static size_t ctrl_scan(const _Atomic uint8_t *c, size_t n, uint8_t tag)
+{
+	size_t i = 0;
+#ifdef LFHT_SIMD
+	const __m128i vt = _mm_set1_epi8(tag), vany = _mm_set1_epi8(CTRL_ANY),
+		zero = _mm_setzero_si128();
+	for(; i + 16 <= n; i += 16) {
+		__m128i x = _mm_loadu_si128((const __m128i *)&c[i]);
+		int m = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, zero),
+			_mm_or_si128(_mm_cmpeq_epi8(x, vt), _mm_cmpeq_epi8(x, vany))));
+		if(m != 0) return i + __builtin_ctz(m);
+	}
+#endif
+	for(; i < n; i++) {
+		uint8_t b = atomic_load_explicit(&c[i], memory_order_relaxed);
+		if(b == 0 || b == tag || b == CTRL_ANY) break;
+	}
+	return i;
+}
+
+
+/* like probe_skip(), but over control bytes for a lookup of @tag. */
+static size_t ctrl_skip(
+	const struct lfht_table *t, size_t off, size_t end, uint8_t tag)
+{
+	if(off == end) return end;
+	size_t lim = end > off ? end : 1ul << t->size_log2,
+		n = ctrl_scan(&t->ctrl[off], lim - off, tag);
+	if(off + n < lim || lim == end) return off + n;
+	return ctrl_scan(&t->ctrl[0], end, tag);
+}
+
+
+/* returns the first offset from @off towards @end that isn't in a block
+ * that's been migrated in full, or @end if there is none or the probe would
+ * have ended at a void in one that has.
+ */
+static inline size_t mig_skip(
+	const struct lfht_table *t, size_t off, size_t end)
+{
+	size_t mask = (1ul << t->size_log2) - 1,
+		bmask = (1ul << MIG_BLOCK_LOG2) - 1,
+		dist = (end - off) & mask;
+	while(off != end) {
+		uint16_t s = atomic_load_explicit(
+			&t->mig_done[off >> MIG_BLOCK_LOG2], memory_order_relaxed);
+		if((s & MIG_BLOCK_DONE) == 0) break;
+		if((s & MIG_BLOCK_HAS_VOID) != 0
+			&& ((s >> MIG_BLOCK_VOID_SHIFT) & bmask) >= (off & bmask))
+		{
+			return end;
+		}
+		size_t rest = (1ul << MIG_BLOCK_LOG2) - (off & bmask);
+		if(rest >= dist) return end;
+		off = (off + rest) & mask;
+		dist -= rest;
+	}
+	return off;
+}
+
+
+/* counts @n slots from @spos up off towards @src's summary for their block,
+ * which they must all be in. whoever counts off the last one marks the block
+ * as done if every slot in it has mig_bit set; since slots may be handed out
+ * again after migration halts, the count saturates and a block may end up
+ * not being marked, which costs nothing but the skip.
+ */
+static void mig_block_count(struct lfht_table *src, size_t spos, int n)
+{
+	size_t b = spos >> MIG_BLOCK_LOG2, first = b << MIG_BLOCK_LOG2,
+		size = 1ul << MIG_BLOCK_LOG2;
+	if(first + size > (1ul << src->size_log2)) {
+		size = (1ul << src->size_log2) - first;
+	}
+	assert(spos + n <= first + size);
+	uint16_t s = atomic_load_explicit(&src->mig_done[b],
+		memory_order_relaxed), c;
+	do {
+		c = s & MIG_BLOCK_COUNT;
+		if(c >= size) return;
+		c = c + n < size ? c + n : size;
+	} while(!atomic_compare_exchange_weak_explicit(&src->mig_done[b], &s,
+		(s & ~MIG_BLOCK_COUNT) | c,
+		memory_order_acq_rel, memory_order_relaxed));
+	if(c < size) return;
+
+	/* (acquire on the count sees the other counters' slots.) */
+	int last_void = -1;
+	for(size_t i = 0; i < size; i++) {
+		uintptr_t e = atomic_load_explicit(&src->table[first + i],
+			memory_order_relaxed);
+		if((e & src->mig_bit) == 0) return;
+		if(is_void(src, e)) last_void = i;
+	}
+	uint16_t set = MIG_BLOCK_DONE;
+	if(last_void >= 0) {
+		set |= MIG_BLOCK_HAS_VOID | last_void << MIG_BLOCK_VOID_SHIFT;
+	}
+	atomic_fetch_or_explicit(&src->mig_done[b], set, memory_order_release);
+}
+
+
+/* rehash_fn of tables set up by lfht_int_init(), which slot_hash() calls
+ * directly; lfht_copy() and the like pass it on with the rest.
+ */
+static size_t int_rehash(const void *ptr, void *priv) {
+	return lfht_int_hash(lfht_int_key(ptr));
+}
+
+
+/* hash of @ptr, found at @pos in @t. takes it from the side array under
+ * LFHT_STORE_HASH if it's there, and from rehash_fn otherwise. integer keys
+ * are hashed directly.
+ */
+static size_t slot_hash(
+	const struct lfht *ht, const struct lfht_table *t, size_t pos, void *ptr)
+{
+	if(ht->rehash_fn == &int_rehash) {
+		/* cheaper than either. */
+		return lfht_int_hash(lfht_int_key(ptr));
+	}
+	if(t->hashes != NULL) {
+		struct lfht_hash_pair hp = atomic_load_explicit(&t->hashes[pos],
+			memory_order_relaxed);
+		if(hp.ptr == (uintptr_t)ptr) return hp.hash;
+	}
+	return (*ht->rehash_fn)(ptr, ht->priv);
+}
+
+
+/* true if @e at @pos in @t is known to not hash to @hash. */
+static bool hash_differs(
+	const struct lfht_table *t, size_t pos, uintptr_t e, size_t hash)
+{
+	struct lfht_hash_pair hp = atomic_load_explicit(&t->hashes[pos],
+		memory_order_relaxed);
+	return hp.ptr == (uintptr_t)get_raw_ptr(t, e) && hp.hash != hash;
+}
+
+
 /* initialize for a new @tab. */
 static inline void lfht_iter_init(
 	struct lfht_iter *it, struct lfht_table *tab, size_t hash)
 {
 	size_t mask = (1ul << tab->size_log2) - 1;
 	it->t = tab;
-	it->off = hash & mask;
+	it->off = table_hash(tab, hash) & mask;
 	it->end = (it->off + tab->max_probe) & mask;
 	it->hash = hash;
 	it->perfect = tab->perfect_bit;
@@ -576,7 +1040,8 @@ static int ht_add(
 	assert(((uintptr_t)p & it->t->common_mask) == it->t->common_bits);
 	assert((extra_bits & it->t->hazard_bit) == 0);
 
-	uintptr_t perfect = it->t->perfect_bit;
+	uintptr_t perfect = it->t->perfect_bit,
+		zmask = ~(it->t->del_bit | it->t->hazard_bit);
 	size_t mask = (1ul << it->t->size_log2) - 1;
 	do {
 		uintptr_t e = atomic_load_explicit(&it->t->table[it->off],
@@ -600,6 +1065,15 @@ retry:
 			*new_entry_p = hval;
 			assert(is_val(it->t, hval));
 			assert((e & it->t->hazard_bit) == (hval & it->t->hazard_bit));
+			if(it->t->ctrl != NULL) {
+				ctrl_mark(it->t, it->off, ctrl_tag(it->hash));
+			}
+			if(it->t->hashes != NULL) {
+				/* ordered before the entry by the release below. */
+				atomic_store_explicit(&it->t->hashes[it->off],
+					((struct lfht_hash_pair){ (uintptr_t)p, it->hash }),
+					memory_order_relaxed);
+			}
 			if(!atomic_compare_exchange_strong_explicit(
 				&it->t->table[it->off], &e, hval,
 				memory_order_release, memory_order_relaxed))
@@ -613,10 +1087,14 @@ retry:
 					memory_order_relaxed);
 			}
 			assert(it->off >= 0 && it->off <= SSIZE_MAX);
+			PROBE_HIST(it->t, LFHT_PROBE_ADD, it->hash, it->off);
 			return 0;
 		}
 		it->off = (it->off + 1) & mask;
 		perfect = 0;
+		/* empty slots and migration pointers are interesting. */
+		it->off = probe_skip(it->t, it->off, it->end,
+			zmask, it->t->mig_bit, it->t->mig_bit);
 	} while(it->off != it->end);
 	return -ENOSPC;
 }
@@ -631,27 +1109,61 @@ static void *ht_val(
 {
 	uintptr_t mask = (1ul << it->t->size_log2) - 1,
 		perfect = it->perfect,
-		h2 = get_hash_ptr_bits(it->t, hash) | perfect;
+		h2 = get_hash_ptr_bits(it->t, hash) | perfect,
+		emask = (it->t->common_mask
+				& ~(it->t->resv_mask & ~it->t->perfect_bit))
+			| it->t->del_bit | it->t->mig_bit;
+	size_t start = it->off;
+	it->off = mig_skip(it->t, it->off, it->end);
+	if(it->off == it->end) goto miss;
+	uint8_t tag = 0;
+	if(it->t->ctrl != NULL) {
+		/* from the very first slot, since the control bytes are where the
+		 * saving is.
+		 */
+		tag = ctrl_tag(hash);
+		it->off = ctrl_skip(it->t, it->off, it->end, tag);
+		if(it->off == it->end) goto miss;
+	}
+	if(it->off != start) h2 &= ~perfect;
 	do {
 		uintptr_t e = atomic_load_explicit(&it->t->table[it->off],
 			memory_order_relaxed);
 		if(is_void(it->t, e)) break;
-		if(is_val(it->t, e) && get_extra_ptr_bits(it->t, e) == h2) {
+		if(is_val(it->t, e) && get_extra_ptr_bits(it->t, e) == h2
+			&& (likely((ht->flags & LFHT_CHECK_HASH) == 0)
+				|| !hash_differs(it->t, it->off, e, hash)))
+		{
+			PROBE_HIST(it->t, LFHT_PROBE_HIT, hash, it->off);
 			return get_raw_ptr(it->t, e);
 		}
 		it->off = (it->off + 1) & mask;
 		h2 &= ~perfect;
+		it->off = mig_skip(it->t, it->off, it->end);
+		if(it->off == it->end) break;
+		if(it->t->ctrl != NULL) {
+			it->off = ctrl_skip(it->t, it->off, it->end, tag);
+		} else {
+			/* void slots and those that'd match @h2 are interesting; see
+			 * is_void() and is_val().
+			 */
+			it->off = probe_skip(it->t, it->off, it->end,
+				~it->t->mig_bit, emask, h2);
+		}
 	} while(it->off != it->end);
 
+miss:
+	PROBE_HIST(it->t, LFHT_PROBE_MISS, hash, it->off);
 	return NULL;
 }
 
 
 /* check elems & deleted on @t. return zero if @t isn't too full yet, -1 when
  * it could use a rehash (because of many deleted slots), and 1 when it's too
- * full of valid entries.
+ * full of valid entries. returns -2 when @t is the only table in @ht, larger
+ * than @ht's first table, and less than 1/8th full, so it could be halved.
  */
-static int ht_full_test(struct lfht_table *t)
+static int ht_full_test(struct lfht *ht, struct lfht_table *t)
 {
 	int ret = 0;
 
@@ -662,7 +1174,14 @@ static int ht_full_test(struct lfht_table *t)
 	if(atomic_fetch_sub_explicit(cc, 1, memory_order_relaxed) <= 1) {
 		size_t elems, deleted;
 		get_totals(&elems, &deleted, NULL, t);
-		if(elems + 1 <= t->max && elems + 1 + deleted > t->max_with_deleted) {
+		if(elems < (1ul << t->size_log2) / 8
+			&& t->size_log2 > ht->first_size_log2
+			&& t->size_log2 > t->keep_log2 && get_next(t) == NULL)
+		{
+			ret = -2;
+		} else if(elems + 1 <= t->max
+			&& elems + 1 + deleted > t->max_with_deleted)
+		{
 			ret = -1;
 		} else if(elems + 1 > t->max) {
 			ret = 1;
@@ -754,7 +1273,7 @@ static ssize_t ht_mig_mark_and_copy(
 
 	/* source entry marked, add dst copy. */
 	void *ptr = get_raw_ptr(src, e);
-	size_t hash = (*ht->rehash_fn)(ptr, ht->priv);
+	size_t hash = slot_hash(ht, src, spos, ptr);
 	*hash_p = hash;
 	static _Thread_local struct lfht_iter it = { };
 	static _Thread_local int eck = 0;
@@ -988,8 +1507,8 @@ e_retry:
 	if(n <= 0) return n;	/* simple completion and skipping. */
 
 dst_retry:
-	n = ht_full_test(dst);
-	if(n != 0) n = -ENOSPC;	/* halts migration until next main. */
+	n = ht_full_test(ht, dst);
+	if(n != 0 && n != -2) n = -ENOSPC;	/* halts migration until next main. */
 	else {
 		n = ht_mig_mark_and_copy(&hash, &dstval, ht, dst,
 			src, src_pc, spos, &e);
@@ -1039,21 +1558,25 @@ dst_retry:
 }
 
 
-static ssize_t take_percpu_work(struct lfht_table_percpu *c)
+/* claims up to MIG_CLAIM slots from @c, being @return and the *@n_p - 1
+ * slots below it.
+ */
+static ssize_t take_percpu_work(struct lfht_table_percpu *c, int *n_p)
 {
 	ssize_t next = atomic_load_explicit(&c->mig_next,
-		memory_order_relaxed);
-	while(next >= c->mig_last
-		&& !atomic_compare_exchange_weak(&c->mig_next, &next, next - 1))
-	{
-		/* spin */
+		memory_order_relaxed), n = 0;
+	while(next >= c->mig_last) {
+		n = next - c->mig_last + 1;
+		if(n > MIG_CLAIM) n = MIG_CLAIM;
+		if(atomic_compare_exchange_weak(&c->mig_next, &next, next - n)) break;
 	}
+	*n_p = n;
 	return next < c->mig_last ? -1 : next;
 }
 
 
 static ssize_t take_mig_work(
-	bool *last_p,
+	bool *last_p, int *n_p,
 	struct lfht_table_percpu **pc_p,
 	struct lfht_table *src)
 {
@@ -1063,7 +1586,7 @@ static ssize_t take_mig_work(
 		i++)
 	{
 		struct lfht_table_percpu *c = percpu_get(src->pc, base ^ i);
-		work = take_percpu_work(c);
+		work = take_percpu_work(c, n_p);
 		if(work >= 0) {
 			*pc_p = c;
 			*last_p = (i == src->pc->n_buckets - 1);
@@ -1074,9 +1597,9 @@ static ssize_t take_mig_work(
 }
 
 
-/* driver function of the migration operation. gets a work slot in @src and
- * passes it along to ht_migrate_entry(), removing tables as migration
- * completes.
+/* driver function of the migration operation. claims a few work slots in
+ * @src and passes each along to ht_migrate_entry(), removing tables as
+ * migration completes.
  *
  * returns true when @src became empty, was already empty, or migration was
  * blocked on it.
@@ -1086,45 +1609,79 @@ static bool ht_migrate_once(
 {
 	struct lfht_table_percpu *src_pc;
 	bool last_chunk;
-	for(;;) {
-		ssize_t spos = take_mig_work(&last_chunk, &src_pc, src);
+	int done = 0;
+	do {
+		int n_slots, n = 0;
+		ssize_t spos = take_mig_work(&last_chunk, &n_slots, &src_pc, src);
 		if(spos < 0) return true;	/* skip table (completed) */
 
-		int n = ht_migrate_entry(ht, dst, src, src_pc, spos);
-		if(n == 0) break;	/* ok */
-		else if(n > 0) return true;	/* skip table (blocked) */
-		assert(n < 0);	/* skip row (take again) */
-	}
+		/* slots are counted off towards their block's summary as the bottom
+		 * of each block, or of the claim, goes by.
+		 */
+		ssize_t pos = spos, top = spos;
+		for(; pos > spos - n_slots; pos--) {
+			n = ht_migrate_entry(ht, dst, src, src_pc, pos);
+			if(n > 0) break;
+			if((pos & ((1l << MIG_BLOCK_LOG2) - 1)) == 0) {
+				mig_block_count(src, pos, top - pos + 1);
+				top = pos - 1;
+			}
+			if(n < 0) continue;	/* skip row */
+
+			/* check it off and test for completion. */
+			done++;
+			if(ht_mig_advance(ht, src, src_pc, last_chunk)) return true;
+		}
+		if(top > pos) mig_block_count(src, pos + 1, top - pos);
+		if(n > 0) return true;	/* skip table (blocked) */
+	} while(done == 0);		/* take again */
 
-	/* check it off and test for completion. */
-	return ht_mig_advance(ht, src, src_pc, last_chunk);
+	return false;
 }
 
 
-/* examine and possibly migrate one entry from a smaller secondary table into
- * @ht's main table (double), or three from an equal-sized secondary table or
- * if there's more than one secondary table (rehash/remask).
- *
- * the doubling of size ensures that the secondary is emptied by the time the
- * primary fills up, and the doubling threshold's kicking in at 3/4 full means
- * a 3:1 ratio will achieve the same for rehash/remask (though significantly
- * ahead of time).
+/* returns the oldest table below @dst that's not halted wrt @dst, or NULL.
+ * *@single_p is cleared when @dst has secondaries.
  */
-static void ht_migrate(struct lfht *ht, struct lfht_table *dst)
+static struct lfht_table *mig_source(struct lfht_table *dst, bool *single_p)
 {
-	bool single = true;
+	*single_p = true;
 	struct lfht_table *sec = NULL, *next = dst;
 	for(;;) {
 		next = get_next(next);
 		if(next == NULL) break;
-		single = false;
+		*single_p = false;
 		unsigned long halt_gen = atomic_load_explicit(
 			&next->halt_gen_id, memory_order_relaxed);
 		if(halt_gen < dst->gen_id) sec = next;
 	}
+	return sec;
+}
+
+
+/* examine and possibly migrate one entry from a smaller secondary table into
+ * @ht's main table (double), three from an equal-sized secondary table or
+ * if there's more than one secondary table (rehash/remask), or six from a
+ * larger one (shrink); rounded up to whole claims of MIG_CLAIM slots.
+ *
+ * the doubling of size ensures that the secondary is emptied by the time the
+ * primary fills up, and the doubling threshold's kicking in at 3/4 full means
+ * a 3:1 ratio will achieve the same for rehash/remask (though significantly
+ * ahead of time).
+ */
+static void ht_migrate(struct lfht *ht, struct lfht_table *dst)
+{
+	bool single;
+	struct lfht_table *sec = mig_source(dst, &single);
 	if(sec == NULL) return;		/* nothing to do! */
 
 	int n_times = dst->size_log2 > sec->size_log2 && single ? 1 : 3;
+	if(sec->size_log2 > dst->size_log2) {
+		/* shrinking; keep up with the source's size. */
+		n_times <<= sec->size_log2 - dst->size_log2;
+	}
+	/* in claims of MIG_CLAIM slots each. */
+	n_times = (n_times + MIG_CLAIM - 1) / MIG_CLAIM;
 	for(int i=0; i < n_times; i++) {
 		if(ht_migrate_once(ht, dst, sec) && n_times > 1) {
 			sec = next_table_gen(ht, sec, true);
@@ -1139,108 +1696,1015 @@ static void ht_migrate(struct lfht *ht, struct lfht_table *dst)
 }
 
 
-void lfht_init(
-	struct lfht *ht,
-	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv)
+/* the escape table: where items go that'd leave a table's common_mask with
+ * fewer than MIN_COMMON_BITS to spare for the reserved bits and a hash bit,
+ * such as when they're spread all over the address space. it's open
+ * addressing over wide slots of hash and pointer, so it needs no reserved
+ * bits at all, in generations of doubling size, newest first. adds CAS an
+ * unused or deleted slot of the newest generation, pushing a new one in
+ * front once it's 3/4 used; deletes and esc_replace() CAS the item's slot in
+ * whichever generation has it. items never move, so lookups go through every
+ * generation. all of it is lock-free, and freed only by lfht_clear(). meant
+ * for a few outliers, not the bulk of the items; lfht_copy() moves those it
+ * can back into a table.
+ */
+#define ESC_TOMB ((uintptr_t)1)		/* deleted slot's ptr */
+#define ESC_MIN_SIZE_LOG2 4
+
+struct lfht_esc
 {
-	struct lfht t = LFHT_INITIALIZER(t, rehash_fn, priv);
-	*ht = t;
-}
+	struct lfht_esc *next;		/* older generation, or NULL */
+	size_t size_log2;
+	_Atomic size_t used;		/* slots that've had an item */
+	_Atomic struct lfht_hash_pair slots[];
+};
 
 
-void lfht_init_sized(
-	struct lfht *ht,
-	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv,
-	size_t size)
+static struct lfht_esc *esc_new(int sizelog2, struct lfht_esc *next)
 {
-	lfht_init(ht, rehash_fn, priv);
-	int sizelog2 = MIN_SIZE_LOG2;
-	while(1UL << sizelog2 < size) {
-		sizelog2++;
-		if(sizelog2 == sizeof(long) * 8 - 1) break;
-	}
-	ht->first_size_log2 = sizelog2;
+	size_t sz = sizeof(struct lfht_esc)
+		+ sizeof(struct lfht_hash_pair) * (1ul << sizelog2);
+	struct lfht_esc *x = aligned_alloc(alignof(struct lfht_esc), sz);
+	if(x == NULL) return NULL;
+	memset(x, 0, sz);
+	x->next = next;
+	x->size_log2 = sizelog2;
+	return x;
 }
 
 
-void lfht_clear(struct lfht *ht)
+/* pushes a generation twice the size of @x in front of it, unless another
+ * thread got there first. false on malloc failure.
+ */
+static bool esc_push(struct lfht *ht, struct lfht_esc *x)
 {
-	int eck = e_begin();
-	struct nbsl_iter it;
-	for(struct nbsl_node *cur = nbsl_first(&ht->tables, &it);
-		cur != NULL;
-		cur = nbsl_next(&ht->tables, &it))
+	struct lfht_esc *nx = esc_new(
+		x == NULL ? ESC_MIN_SIZE_LOG2 : x->size_log2 + 1, x);
+	if(nx == NULL) return false;
+	if(!atomic_compare_exchange_strong_explicit(&ht->esc, &x, nx,
+		memory_order_release, memory_order_relaxed))
 	{
-		struct lfht_table *tab = container_of(cur, struct lfht_table, link);
-		if(!nbsl_del_at(&ht->tables, &it)) continue;
-		e_free(tab->table);
-		e_free(tab);
+		free(nx);
 	}
-	e_end(eck);
+	return true;
 }
 
 
-bool lfht_add_many(struct lfht *ht, struct lfht_iter *it, void *p)
+/* store @hp in an unused or deleted slot of @x. false if there are none. */
+static bool esc_put(struct lfht_esc *x, struct lfht_hash_pair hp)
 {
-	int eck = e_begin();
-
-	struct lfht_table *tab = get_main(ht);
-	if(unlikely(tab == NULL)) {
-		tab = new_table(ht->first_size_log2);
-		if(tab == NULL) goto fail;
-		set_bits(ht->first_size_log2, tab, NULL, p);
-		if(!nbsl_push(&ht->tables, NULL, &tab->link)) {
-			free(tab->table);
-			free(tab);
-			tab = get_main(ht);
-			assert(tab != NULL);
+	size_t mask = (1ul << x->size_log2) - 1;
+	for(size_t i = 0, pos = hp.hash & mask; i <= mask;
+		i++, pos = (pos + 1) & mask)
+	{
+		struct lfht_hash_pair old = atomic_load_explicit(&x->slots[pos],
+			memory_order_relaxed);
+		while(old.ptr <= ESC_TOMB) {
+			if(atomic_compare_exchange_weak_explicit(&x->slots[pos], &old,
+				hp, memory_order_release, memory_order_relaxed))
+			{
+				if(old.ptr == 0) {
+					atomic_fetch_add_explicit(&x->used, 1,
+						memory_order_relaxed);
+				}
+				return true;
+			}
 		}
 	}
-	if(it->t != tab) lfht_iter_init(it, tab, it->hash);
+	return false;
+}
+
+
+static bool esc_add(struct lfht *ht, size_t hash, void *p)
+{
+	assert((uintptr_t)p > ESC_TOMB);
+	struct lfht_hash_pair hp = { (uintptr_t)p, hash };
+	for(;;) {
+		struct lfht_esc *x = atomic_load_explicit(&ht->esc,
+			memory_order_acquire);
+		if(x == NULL || atomic_load_explicit(&x->used, memory_order_relaxed)
+			+ 1 > ((size_t)3 << x->size_log2) / 4
+			|| !esc_put(x, hp))
+		{
+			if(!esc_push(ht, x)) return false;
+			continue;
+		}
+		atomic_fetch_add_explicit(&ht->n_escaped, 1, memory_order_relaxed);
+		return true;
+	}
+}
+
+
+/* swaps the first slot holding @old in any generation of @ht's escape table
+ * for @new. false if there's none.
+ */
+static bool esc_swap(
+	struct lfht *ht, struct lfht_hash_pair old, struct lfht_hash_pair new)
+{
+	for(struct lfht_esc *x = atomic_load_explicit(&ht->esc,
+			memory_order_acquire);
+		x != NULL; x = x->next)
+	{
+		size_t mask = (1ul << x->size_log2) - 1;
+		for(size_t i = 0, pos = old.hash & mask; i <= mask;
+			i++, pos = (pos + 1) & mask)
+		{
+			struct lfht_hash_pair hp = atomic_load_explicit(&x->slots[pos],
+				memory_order_relaxed);
+			if(hp.ptr == 0) break;
+			/* (where the CAS fails, it was just deleted or replaced.) */
+			if(hp.ptr == old.ptr && hp.hash == old.hash
+				&& atomic_compare_exchange_strong_explicit(&x->slots[pos],
+					&hp, new, memory_order_release, memory_order_relaxed))
+			{
+				return true;
+			}
+		}
+	}
+	return false;
+}
+
+
+static bool esc_del(struct lfht *ht, size_t hash, const void *p)
+{
+	if(!esc_swap(ht, (struct lfht_hash_pair){ (uintptr_t)p, hash },
+		(struct lfht_hash_pair){ ESC_TOMB, 0 }))
+	{
+		return false;
+	}
+	atomic_fetch_sub_explicit(&ht->n_escaped, 1, memory_order_relaxed);
+	return true;
+}
+
+
+/* sets @it up for a lookup of @hash in the escape table generation @x, or
+ * past the escape table when that's NULL, which returns false.
+ */
+static inline bool esc_start(
+	struct lfht_iter *it, struct lfht_esc *x, size_t hash)
+{
+	it->esc = x;
+	if(x == NULL) return false;
+	it->off = it->end = hash & ((1ul << x->size_log2) - 1);
+	return true;
+}
+
+
+/* finds the next item for @hash in @it->esc from @it->off on, and in the
+ * older generations after that. clears @it->esc once there are none.
+ */
+static void *esc_val(struct lfht_iter *it, size_t hash)
+{
+	do {
+		size_t mask = (1ul << it->esc->size_log2) - 1;
+		do {
+			struct lfht_hash_pair hp = atomic_load_explicit(
+				&it->esc->slots[it->off], memory_order_acquire);
+			if(hp.ptr == 0) break;
+			if(hp.ptr != ESC_TOMB && hp.hash == hash) return (void *)hp.ptr;
+			it->off = (it->off + 1) & mask;
+		} while(it->off != it->end);
+	} while(esc_start(it, it->esc->next, hash));
+	return NULL;
+}
+
+
+/* continues a lookup in @ht's escape table, after the lfht_table ones. */
+static void *esc_firstval(struct lfht *ht, struct lfht_iter *it, size_t hash)
+{
+	it->t = NULL;
+	it->hash = hash;
+	if(likely(!esc_start(it,
+		atomic_load_explicit(&ht->esc, memory_order_acquire), hash)))
+	{
+		return NULL;
+	}
+	return esc_val(it, hash);
+}
+
+
+bool lfht_migrate_assist(struct lfht *ht, size_t budget)
+{
+	assert(e_inside());
+
+	for(size_t i = 0; i < budget; i++) {
+		struct lfht_table *dst = get_main(ht);
+		if(dst == NULL) return false;
+		bool single;
+		struct lfht_table *sec = mig_source(dst, &single);
+		if(sec == NULL) return false;
+		ht_migrate_once(ht, dst, sec);
+	}
+
+	/* (halted tables wait for the next main table.) */
+	struct lfht_table *dst = get_main(ht);
+	bool single;
+	return dst != NULL && mig_source(dst, &single) != NULL;
+}
+
+
+struct lfht_migrator
+{
+	struct lfht *ht;
+	mtx_t lock;
+	cnd_t cond;
+	bool stop;
+	_Atomic bool idle;	/* set while waiting on @cond, under @lock */
+	thrd_t thread;
+};
+
+
+static int migrator_fn(void *priv)
+{
+	struct lfht_migrator *m = priv;
+	mtx_lock(&m->lock);
+	while(!m->stop) {
+		mtx_unlock(&m->lock);
+		int eck = e_begin();
+		bool more = lfht_migrate_assist(m->ht, LFHT_MIGRATOR_BUDGET);
+		e_end(eck);
+		mtx_lock(&m->lock);
+		if(more || m->stop) continue;
+
+		/* wait for the next resize. migrator_kick() either sees @idle and
+		 * signals once we're waiting, or pushed its table before the look
+		 * below.
+		 */
+		atomic_store(&m->idle, true);
+		atomic_thread_fence(memory_order_seq_cst);
+		eck = e_begin();
+		more = lfht_migrate_assist(m->ht, 0);
+		e_end(eck);
+		if(!more) cnd_wait(&m->cond, &m->lock);
+		atomic_store_explicit(&m->idle, false, memory_order_relaxed);
+	}
+	mtx_unlock(&m->lock);
+	return 0;
+}
+
+
+/* wakes @ht's migrator up if it's waiting. called after a new main table
+ * was pushed over an old one, inside the same epoch bracket.
+ */
+static void migrator_kick(struct lfht *ht)
+{
+	struct lfht_migrator *m = atomic_load_explicit(&ht->migrator,
+		memory_order_acquire);
+	if(likely(m == NULL)) return;
+	atomic_thread_fence(memory_order_seq_cst);
+	if(!atomic_load_explicit(&m->idle, memory_order_relaxed)) return;
+	mtx_lock(&m->lock);
+	cnd_signal(&m->cond);
+	mtx_unlock(&m->lock);
+}
+
+
+static void migrator_free(struct lfht_migrator *m)
+{
+	cnd_destroy(&m->cond);
+	mtx_destroy(&m->lock);
+	free(m);
+}
+
+
+struct lfht_migrator *lfht_migrator_start(struct lfht *ht)
+{
+	struct lfht_migrator *m = malloc(sizeof *m);
+	if(m == NULL) return NULL;
+	*m = (struct lfht_migrator){ .ht = ht };
+	if(mtx_init(&m->lock, mtx_plain) != thrd_success) {
+		free(m);
+		return NULL;
+	}
+	if(cnd_init(&m->cond) != thrd_success) {
+		mtx_destroy(&m->lock);
+		free(m);
+		return NULL;
+	}
+	if(thrd_create(&m->thread, &migrator_fn, m) != thrd_success) {
+		migrator_free(m);
+		return NULL;
+	}
+	atomic_store_explicit(&ht->migrator, m, memory_order_release);
+	return m;
+}
+
+
+void lfht_migrator_stop(struct lfht_migrator *m)
+{
+	if(m == NULL) return;
+	atomic_store_explicit(&m->ht->migrator, NULL, memory_order_relaxed);
+	mtx_lock(&m->lock);
+	m->stop = true;
+	cnd_signal(&m->cond);
+	mtx_unlock(&m->lock);
+	thrd_join(m->thread, NULL);
+	/* (migrator_kick() may still have it.) */
+	e_call_dtor(&migrator_free, m);
+}
+
+
+void lfht_init(
+	struct lfht *ht,
+	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv)
+{
+	struct lfht t = LFHT_INITIALIZER(t, rehash_fn, priv);
+	*ht = t;
+}
+
+
+void lfht_init_sized(
+	struct lfht *ht,
+	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv,
+	size_t size)
+{
+	lfht_init(ht, rehash_fn, priv);
+	int sizelog2 = MIN_SIZE_LOG2;
+	while(1UL << sizelog2 < size) {
+		sizelog2++;
+		if(sizelog2 == sizeof(long) * 8 - 1) break;
+	}
+	ht->first_size_log2 = sizelog2;
+}
+
+
+/* smallest size_log2 not below @min_log2 for a table that holds @n items
+ * without exceeding its ->max.
+ */
+static int size_log2_for(size_t n, int min_log2)
+{
+	int sizelog2 = min_log2 > MIN_SIZE_LOG2 ? min_log2 : MIN_SIZE_LOG2;
+	while(((size_t)3 << sizelog2) / 4 < n) {
+		sizelog2++;
+		if(sizelog2 == sizeof(long) * 8 - 1) break;
+	}
+	return sizelog2;
+}
+
+
+bool lfht_rehash(struct lfht *ht, size_t seed)
+{
+	atomic_store_explicit(&ht->seed, seed, memory_order_relaxed);
+	int eck = e_begin();
+	bool ok = true;
+	/* a concurrent resize may have read the seed from before, and won the
+	 * race to be the main table; then go again. a concurrent lfht_rehash()
+	 * with another seed supersedes this one.
+	 */
+	struct lfht_table *tab;
+	while((tab = get_main(ht)) != NULL && tab->seed != seed
+		&& atomic_load_explicit(&ht->seed, memory_order_relaxed) == seed)
+	{
+		if(rehash_table(ht, tab) == tab) {
+			/* malloc failed. */
+			ok = false;
+			break;
+		}
+	}
+	e_end(eck);
+	return ok;
+}
+
+
+bool lfht_reserve(struct lfht *ht, size_t n)
+{
+	int sizelog2 = size_log2_for(n, MIN_SIZE_LOG2);
+
+	/* for the first table, if there's none yet; first_table() looks again
+	 * after it's installed.
+	 */
+	increase_to(&ht->reserve_log2, (unsigned)sizelog2);
+
+	int eck = e_begin();
+	struct lfht_table *tab = get_main(ht);
+	bool ok = true;
+	if(tab != NULL && tab->size_log2 < sizelog2) {
+		ok = grow_table(ht, tab, sizelog2, sizelog2, NULL) != NULL;
+	}
+	e_end(eck);
+	return ok;
+}
+
+
+void lfht_init_ext(
+	struct lfht *ht,
+	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv,
+	size_t size, unsigned int flags)
+{
+	lfht_init_sized(ht, rehash_fn, priv, size);
+	ht->flags = flags;
+}
+
+
+void lfht_int_init(struct lfht *ht, size_t size, unsigned int flags)
+{
+	lfht_init_ext(ht, &int_rehash, NULL, size, flags);
+}
+
+
+void lfht_clear(struct lfht *ht)
+{
+	int eck = e_begin();
+	struct nbsl_iter it;
+	for(struct nbsl_node *cur = nbsl_first(&ht->tables, &it);
+		cur != NULL;
+		cur = nbsl_next(&ht->tables, &it))
+	{
+		struct lfht_table *tab = container_of(cur, struct lfht_table, link);
+		if(!nbsl_del_at(&ht->tables, &it)) continue;
+		e_free((void *)tab->ctrl);
+		e_free((void *)tab->mig_done);
+		e_free((void *)tab->hashes);
+		e_free(tab->table);
+		e_free(tab);
+	}
+	struct lfht_esc *x = atomic_exchange_explicit(&ht->esc, NULL,
+		memory_order_acquire);
+	while(x != NULL) {
+		struct lfht_esc *next = x->next;
+		e_free(x);
+		x = next;
+	}
+	atomic_store_explicit(&ht->n_escaped, 0, memory_order_relaxed);
+	atomic_store_explicit(&ht->reserve_log2, 0, memory_order_relaxed);
+	e_end(eck);
+}
+
+
+/* size of the first table, which lfht_reserve() may have raised. */
+static int first_size(struct lfht *ht)
+{
+	int res = atomic_load(&ht->reserve_log2);
+	return res > ht->first_size_log2 ? res : ht->first_size_log2;
+}
+
+
+/* installs a first table in @ht, which had none, that conforms to @model.
+ * returns the main table, which may be another thread's, or NULL on malloc
+ * failure.
+ */
+static struct lfht_table *first_table(struct lfht *ht, void *model)
+{
+	int sizelog2 = first_size(ht);
+	struct lfht_table *tab = new_table(ht, sizelog2);
+	if(tab == NULL) return NULL;
+	set_bits(sizelog2, tab, NULL, model);
+	tab->keep_log2 = sizelog2;
+	if(!nbsl_push(&ht->tables, NULL, &tab->link)) {
+		drop_table(tab);
+		tab = get_main(ht);
+		assert(tab != NULL);
+	}
+
+	/* a concurrent lfht_reserve() either sees a table to grow, or is seen
+	 * here.
+	 */
+	sizelog2 = first_size(ht);
+	if(tab->size_log2 < sizelog2) {
+		tab = grow_table(ht, tab, sizelog2, sizelog2, NULL);
+	}
+	return tab;
+}
+
+
+bool lfht_add_many(struct lfht *ht, struct lfht_iter *it, void *p)
+{
+	int eck = e_begin();
+
+	struct lfht_table *tab = get_main(ht);
+	if(unlikely(tab == NULL)) {
+		tab = first_table(ht, p);
+		if(tab == NULL) goto fail;
+	}
+	if(it->t != tab) lfht_iter_init(it, tab, it->hash);
 
 	int n;
 	do {
+conform:
 		if(((uintptr_t)p & it->t->common_mask) != it->t->common_bits) {
+			if(!can_remask(it->t, p)) {
+				bool ok = esc_add(ht, it->hash, p);
+				e_end(eck);
+				return ok;
+			}
 			it->t = remask_table(ht, it->t, p);
 			if(it->t == NULL) goto fail;
-			assert(((uintptr_t)p & it->t->common_mask) == it->t->common_bits);
 			lfht_iter_init(it, it->t, it->hash);
+			/* may have lost to a table that @p can't conform to. */
+			goto conform;
 		}
 
-		int d = ht_full_test(it->t);
-		if(d < 0) {
+		int d = ht_full_test(ht, it->t);
+		if(d == -1) {
 			it->t = rehash_table(ht, it->t);
 			assert(it->t != NULL);
 			lfht_iter_init(it, it->t, it->hash);
+		} else if(d == -2) {
+			it->t = resize_table(ht, it->t, it->t->size_log2 - 1);
+			assert(it->t != NULL);
+			lfht_iter_init(it, it->t, it->hash);
 		} else if(d > 0) {
 call_double:
 			it->t = double_table(ht, it->t, p);
 			if(it->t == NULL) goto fail;
 			lfht_iter_init(it, it->t, it->hash);
+			if(((uintptr_t)p & it->t->common_mask) != it->t->common_bits) {
+				goto conform;
+			}
+		}
+
+		uintptr_t new_entry;
+		n = ht_add(&new_entry, it, p, 0);
+		if(n == -EAGAIN) {
+			/* @it->t became secondary. reload main and retry to avoid a
+			 * future off-cpu migration.
+			 */
+			it->t = get_main(ht);
+			lfht_iter_init(it, it->t, it->hash);
+		} else if(n == -ENOSPC) {
+			/* probe limit was reached. double the table. */
+			goto call_double;
+		}
+	} while(n < 0);
+	atomic_fetch_add_explicit(&ELEMS(it->t), 1, memory_order_relaxed);
+	ht_migrate(ht, it->t);
+
+	e_end(eck);
+	return true;
+
+fail:
+	e_end(eck);
+	return false;
+}
+
+
+/* fill @tab, which is empty and not yet visible to other threads, with @n
+ * items by storing to the table directly. returns false when an item didn't
+ * fit within @tab->max_probe of its initial position.
+ */
+static bool bulk_fill(
+	struct lfht_table *tab,
+	const size_t *hashes, void *const *ptrs, size_t n)
+{
+	size_t mask = (1ul << tab->size_log2) - 1;
+	for(size_t i = 0; i < n; i++) {
+		assert(((uintptr_t)ptrs[i] & tab->common_mask) == tab->common_bits);
+		size_t pos = table_hash(tab, hashes[i]) & mask, dist = 0;
+		uintptr_t bits = get_hash_ptr_bits(tab, hashes[i]) | tab->perfect_bit;
+		while(atomic_load_explicit(&tab->table[pos],
+			memory_order_relaxed) != 0)
+		{
+			if(++dist == tab->max_probe) return false;
+			pos = (pos + 1) & mask;
+			bits &= ~tab->perfect_bit;
+		}
+		uintptr_t hval = make_hval(tab, ptrs[i], bits);
+		assert(is_val(tab, hval));
+		if(tab->ctrl != NULL) tab->ctrl[pos] = ctrl_tag(hashes[i]);
+		if(tab->hashes != NULL) {
+			atomic_store_explicit(&tab->hashes[pos],
+				((struct lfht_hash_pair){ (uintptr_t)ptrs[i], hashes[i] }),
+				memory_order_relaxed);
+		}
+		atomic_store_explicit(&tab->table[pos], hval, memory_order_relaxed);
+	}
+	atomic_fetch_add_explicit(&ELEMS(tab), n, memory_order_relaxed);
+	return true;
+}
+
+
+bool lfht_add_bulk(
+	struct lfht *ht, const size_t hashes[], void *const ptrs[], size_t n)
+{
+	if(n == 0) return true;
+
+	int eck = e_begin();
+	for(;;) {
+		/* size for @n plus what's already in @ht, counting items that
+		 * remain to be migrated from secondary tables.
+		 */
+		struct lfht_table *top = get_main(ht), *nt;
+		size_t want = n;
+		for(struct lfht_table *t = top; t != NULL; t = get_next(t)) {
+			want += get_total_elems(t);
+		}
+		int first = first_size(ht), sizelog2 = size_log2_for(want,
+			top == NULL ? first : top->size_log2);
+		if(top != NULL && !can_remask(top, ptrs[0])) {
+			/* it'd escape; so might others. */
+			goto one_by_one;
+		}
+
+		for(;;) {
+			nt = new_table(ht, sizelog2);
+			if(nt == NULL) goto fail;
+			if(top == NULL) {
+				set_bits(first, nt, NULL, ptrs[0]);
+				nt->keep_log2 = first;
+			} else {
+				set_bits(0, nt, top, ptrs[0]);
+				nt->gen_id = top->gen_id + 1;
+				if(sizelog2 == top->size_log2) {
+					nt->keep_log2 = top->keep_log2;
+				}
+			}
+			bool remask = false;
+			for(size_t i = 1; i < n; i++) {
+				remask = reduce_common(nt, ptrs[i]) || remask;
+			}
+			if(remask && POPCOUNT(nt->common_mask) < MIN_COMMON_BITS) {
+				/* some must escape; let lfht_add() sort them out. */
+				drop_table(nt);
+				goto one_by_one;
+			}
+			if(remask) set_resv_bits(nt);
+
+			if(bulk_fill(nt, hashes, ptrs, n)) break;
+			/* an unlucky probe chain. try again one size up. */
+			drop_table(nt);
+			sizelog2++;
+		}
+
+		/* existing items, if any, migrate into @nt as per usual. */
+		if(top != NULL) {
+			if(push_main(ht, top, nt)) break;
+		} else if(nbsl_push(&ht->tables, NULL, &nt->link)) {
+			/* as in first_table(). */
+			first = first_size(ht);
+			if(nt->size_log2 < first) grow_table(ht, nt, first, first, NULL);
+			break;
+		}
+		drop_table(nt);
+	}
+
+	e_end(eck);
+	return true;
+
+one_by_one:
+	for(size_t i = 0; i < n; i++) {
+		if(lfht_add(ht, hashes[i], ptrs[i])) continue;
+		/* take back the ones that went in. (any that someone else deleted
+		 * meanwhile are already gone.)
+		 */
+		while(i > 0) {
+			i--;
+			lfht_del(ht, hashes[i], ptrs[i]);
+		}
+		goto fail;
+	}
+	e_end(eck);
+	return true;
+
+fail:
+	e_end(eck);
+	return false;
+}
+
+
+struct copy_item {
+	size_t hash;
+	void *ptr;
+	int tab;			/* index of the table it was read from */
+	size_t pos;
+};
+
+/* one worker's share of lfht_copy_mt(): slots [@lo, @hi) of @t, which is
+ * the @tab'th table read, when reading; and @fill[0..@n_fill) when filling
+ * @nt.
+ */
+struct copy_worker
+{
+	const struct lfht *ht;
+	struct lfht_table *t;
+	int tab, phase;
+	size_t lo, hi;
+	struct copy_item *items;
+	size_t n_items, n_alloc;
+	const struct copy_item *fill;
+	size_t n_fill;
+	struct lfht_table *nt;
+	bool ok;
+	thrd_t thread;
+};
+
+
+/* appends an item to @w's. false on malloc failure. */
+static bool copy_push(
+	struct copy_worker *w, size_t hash, void *ptr, int tab, size_t pos)
+{
+	if(w->n_items == w->n_alloc) {
+		size_t n = w->n_alloc == 0 ? 1024 : w->n_alloc * 2;
+		struct copy_item *m = realloc(w->items, n * sizeof *m);
+		if(m == NULL) return false;
+		w->items = m;
+		w->n_alloc = n;
+	}
+	w->items[w->n_items++] = (struct copy_item){ hash, ptr, tab, pos };
+	return true;
+}
+
+
+static void copy_scan(struct copy_worker *w)
+{
+	int eck = e_begin();
+	struct lfht_table *t = w->t;
+	for(size_t pos = w->lo; pos < w->hi; pos++) {
+		uintptr_t e = atomic_load_explicit(&t->table[pos],
+			memory_order_relaxed);
+		/* entries that are being migrated are taken all the same, and
+		 * sorted out against their copies by copy_dedup().
+		 */
+		if(!is_val(t, e)) continue;
+		void *ptr = get_raw_ptr(t, e);
+		if(!copy_push(w, slot_hash(w->ht, t, pos, ptr), ptr, w->tab, pos)) {
+			w->ok = false;
+			break;
+		}
+	}
+	e_end(eck);
+}
+
+
+/* like bulk_fill(), but for @w's items, and with others doing the same to
+ * @w->nt concurrently.
+ */
+static void copy_fill(struct copy_worker *w)
+{
+	struct lfht_table *tab = w->nt;
+	size_t mask = (1ul << tab->size_log2) - 1;
+	for(size_t i = 0; i < w->n_fill; i++) {
+		const struct copy_item *it = &w->fill[i];
+		assert(((uintptr_t)it->ptr & tab->common_mask) == tab->common_bits);
+		size_t pos = table_hash(tab, it->hash) & mask, dist = 0;
+		uintptr_t bits = get_hash_ptr_bits(tab, it->hash) | tab->perfect_bit,
+			hval = make_hval(tab, it->ptr, bits), e = 0;
+		while(!atomic_compare_exchange_weak_explicit(&tab->table[pos], &e,
+			hval, memory_order_relaxed, memory_order_relaxed))
+		{
+			if(e == 0) continue;	/* spurious */
+			if(++dist == tab->max_probe) {
+				w->ok = false;
+				return;
+			}
+			pos = (pos + 1) & mask;
+			bits &= ~tab->perfect_bit;
+			hval = make_hval(tab, it->ptr, bits);
+			e = 0;
+		}
+		assert(is_val(tab, hval));
+		if(tab->ctrl != NULL) tab->ctrl[pos] = ctrl_tag(it->hash);
+		if(tab->hashes != NULL) {
+			atomic_store_explicit(&tab->hashes[pos],
+				((struct lfht_hash_pair){ (uintptr_t)it->ptr, it->hash }),
+				memory_order_relaxed);
+		}
+	}
+	atomic_fetch_add_explicit(&ELEMS(tab), w->n_fill, memory_order_relaxed);
+}
+
+
+static int copy_worker_fn(void *priv)
+{
+	struct copy_worker *w = priv;
+	if(w->phase == 0) copy_scan(w); else copy_fill(w);
+	return 0;
+}
+
+
+/* runs the current phase of @ws[0..@n) with a thread for each but the
+ * first, which the caller runs. false if any of them failed.
+ */
+static bool copy_run(struct copy_worker *ws, int n)
+{
+	int started;
+	for(started = 1; started < n; started++) {
+		if(thrd_create(&ws[started].thread, &copy_worker_fn,
+			&ws[started]) != thrd_success)
+		{
+			break;
+		}
+	}
+	/* ones that couldn't be started are run here. */
+	for(int i = started; i < n; i++) copy_worker_fn(&ws[i]);
+	copy_worker_fn(&ws[0]);
+	for(int i = 1; i < started; i++) thrd_join(ws[i].thread, NULL);
+
+	bool ok = true;
+	for(int i = 0; i < n; i++) ok = ok && ws[i].ok;
+	return ok;
+}
+
+
+/* moves the others' items into @ws[0]'s. false on malloc failure. */
+static bool copy_merge(struct copy_worker *ws, int n)
+{
+	size_t total = 0;
+	for(int i = 0; i < n; i++) total += ws[i].n_items;
+	if(total > ws[0].n_alloc) {
+		struct copy_item *m = realloc(ws[0].items, total * sizeof *m);
+		if(m == NULL) return false;
+		ws[0].items = m;
+		ws[0].n_alloc = total;
+	}
+	for(int i = 1; i < n; i++) {
+		memcpy(&ws[0].items[ws[0].n_items], ws[i].items,
+			ws[i].n_items * sizeof *ws[i].items);
+		ws[0].n_items += ws[i].n_items;
+		free(ws[i].items);
+		ws[i].items = NULL;
+		ws[i].n_items = ws[i].n_alloc = 0;
+	}
+	return true;
+}
+
+
+/* by pointer, and the newest table first. */
+static int cmp_copy_item(const void *a, const void *b)
+{
+	const struct copy_item *x = a, *y = b;
+	if(x->ptr != y->ptr) return (uintptr_t)x->ptr < (uintptr_t)y->ptr ? -1 : 1;
+	return y->tab - x->tab;
+}
+
+
+/* drops those of @w's items that were read before being migrated into a
+ * table that was read after, i.e. whose slot no longer holds them as is and
+ * whose pointer also came out of a newer table. what's left is each item that
+ * stayed put once, and each that moved once; though a pointer that was added
+ * more than once and moved meanwhile may come out fewer times.
+ */
+static void copy_dedup(struct copy_worker *w, struct lfht_table *const *tabs)
+{
+	qsort(w->items, w->n_items, sizeof *w->items, &cmp_copy_item);
+	void *ptr = NULL;
+	int newest = -1;
+	size_t n = 0;
+	for(size_t i = 0; i < w->n_items; i++) {
+		struct copy_item it = w->items[i];
+		if(i == 0 || it.ptr != ptr) {
+			ptr = it.ptr;
+			newest = it.tab;
+		} else if(it.tab < newest) {
+			struct lfht_table *t = tabs[it.tab];
+			uintptr_t e = atomic_load_explicit(&t->table[it.pos],
+				memory_order_relaxed);
+			if(!is_val(t, e) || (e & t->src_bit) != 0
+				|| get_raw_ptr(t, e) != it.ptr)
+			{
+				continue;
+			}
+		}
+		w->items[n++] = it;
+	}
+	w->n_items = n;
+}
+
+
+bool lfht_copy_mt(struct lfht *dst, struct lfht *src, int n_threads)
+{
+	if(n_threads < 1) n_threads = 1;
+	lfht_init_ext(dst, src->rehash_fn, src->priv, 0, src->flags);
+	dst->first_size_log2 = src->first_size_log2;
+	atomic_store_explicit(&dst->seed,
+		atomic_load_explicit(&src->seed, memory_order_relaxed),
+		memory_order_relaxed);
+
+	int eck = e_begin();
+	int n_tabs = 0, tabs_alloc = 0;
+	struct lfht_table **tabs = NULL;
+	struct copy_worker *ws = calloc(n_threads, sizeof *ws);
+	bool ok = ws != NULL;
+	if(!ok) goto end;
+	for(int i = 0; i < n_threads; i++) {
+		ws[i] = (struct copy_worker){ .ht = src, .ok = true };
+	}
+
+	/* oldest to newest, like lfht_next(), and taking in tables that turn up
+	 * meanwhile; so that an item that's migrated during the copy is read at
+	 * least once, from where it was or where it went. the tables in between
+	 * stay put until the epoch ends.
+	 */
+	for(struct lfht_table *t = get_oldest(src); t != NULL;
+		t = next_table_gen(src, t, false))
+	{
+		if(n_tabs == tabs_alloc) {
+			tabs_alloc = tabs_alloc == 0 ? 4 : tabs_alloc * 2;
+			struct lfht_table **m = realloc(tabs, sizeof *tabs * tabs_alloc);
+			if(m == NULL) {
+				ok = false;
+				goto end;
+			}
+			tabs = m;
+		}
+		size_t size = 1ul << t->size_log2;
+		for(int i = 0; i < n_threads; i++) {
+			ws[i].t = t;
+			ws[i].tab = n_tabs;
+			ws[i].lo = size / n_threads * i;
+			ws[i].hi = i == n_threads - 1 ? size : size / n_threads * (i + 1);
+		}
+		tabs[n_tabs++] = t;
+		ok = copy_run(ws, n_threads);
+		if(!ok) goto end;
+	}
+	ok = copy_merge(ws, n_threads);
+	if(!ok) goto end;
+	/* and at most once. */
+	if(n_tabs > 1) copy_dedup(&ws[0], tabs);
+	struct lfht_table *top = n_tabs > 0 ? tabs[n_tabs - 1] : NULL;
+
+	/* the new table's mask is made from scratch for what's going in it,
+	 * and escaped items that fit join them. a live table's mask only ever
+	 * narrows, so this is where they can; the rest stay escaped.
+	 */
+	struct lfht_table proto;
+	void *model = ws[0].n_items > 0 ? ws[0].items[0].ptr : NULL;
+	if(model != NULL) {
+		set_bits(dst->first_size_log2, &proto, NULL, model);
+		for(size_t j = 0; j < ws[0].n_items; j++) {
+			reduce_common(&proto, ws[0].items[j].ptr);
+		}
+		if(POPCOUNT(proto.common_mask) < MIN_COMMON_BITS) {
+			/* (not expected, as the old one fits them all.) */
+			set_bits(0, &proto, top, NULL);
+		}
+	}
+	struct lfht_esc *esc = atomic_load_explicit(&src->esc,
+		memory_order_acquire);
+	for(struct lfht_esc *x = esc; x != NULL; x = x->next) {
+		for(size_t i = 0; i < (1ul << x->size_log2); i++) {
+			struct lfht_hash_pair hp = atomic_load_explicit(&x->slots[i],
+				memory_order_relaxed);
+			if(hp.ptr <= ESC_TOMB) continue;
+			if(model == NULL) {
+				model = (void *)hp.ptr;
+				set_bits(dst->first_size_log2, &proto, NULL, model);
+			} else if(can_remask(&proto, (void *)hp.ptr)) {
+				reduce_common(&proto, (void *)hp.ptr);
+			}
+		}
+	}
+	if(model == NULL) goto end;
+	set_resv_bits(&proto);
+	/* (escaped items never move, so there's nothing to dedup here.) */
+	for(struct lfht_esc *x = esc; x != NULL; x = x->next) {
+		for(size_t i = 0; ok && i < (1ul << x->size_log2); i++) {
+			struct lfht_hash_pair hp = atomic_load_explicit(&x->slots[i],
+				memory_order_relaxed);
+			if(hp.ptr <= ESC_TOMB) continue;
+			if((hp.ptr & proto.common_mask) == proto.common_bits) {
+				ok = copy_push(&ws[0], hp.hash, (void *)hp.ptr, -1, 0);
+			} else {
+				ok = esc_add(dst, hp.hash, (void *)hp.ptr);
+			}
+		}
+	}
+	size_t n = ws[0].n_items;
+	if(!ok || n == 0) goto end;
+
+	/* the same as lfht_add_bulk(), but in parallel. */
+	int sizelog2 = size_log2_for(n, dst->first_size_log2);
+	for(;;) {
+		struct lfht_table *nt = new_table(dst, sizelog2);
+		if(nt == NULL) {
+			ok = false;
+			break;
+		}
+		set_bits(0, nt, &proto, NULL);
+		for(int i = 0; i < n_threads; i++) {
+			size_t lo = n / n_threads * i,
+				hi = i == n_threads - 1 ? n : n / n_threads * (i + 1);
+			ws[i].phase = 1;
+			ws[i].nt = nt;
+			ws[i].fill = &ws[0].items[lo];
+			ws[i].n_fill = hi - lo;
 		}
-
-		uintptr_t new_entry;
-		n = ht_add(&new_entry, it, p, 0);
-		if(n == -EAGAIN) {
-			/* @it->t became secondary. reload main and retry to avoid a
-			 * future off-cpu migration.
-			 */
-			it->t = get_main(ht);
-			lfht_iter_init(it, it->t, it->hash);
-		} else if(n == -ENOSPC) {
-			/* probe limit was reached. double the table. */
-			goto call_double;
+		if(copy_run(ws, n_threads)) {
+			/* (@dst isn't anyone else's yet, so this won't fail.) */
+			if(!nbsl_push(&dst->tables, NULL, &nt->link)) {
+				drop_table(nt);
+				ok = false;
+			}
+			break;
 		}
-	} while(n < 0);
-	atomic_fetch_add_explicit(&ELEMS(it->t), 1, memory_order_relaxed);
-	ht_migrate(ht, it->t);
+		/* an unlucky probe chain. try again one size up. */
+		drop_table(nt);
+		for(int i = 0; i < n_threads; i++) ws[i].ok = true;
+		sizelog2++;
+	}
 
+end:
 	e_end(eck);
-	return true;
+	for(int i = 0; ws != NULL && i < n_threads; i++) free(ws[i].items);
+	free(ws);
+	free(tabs);
+	if(!ok) lfht_clear(dst);
+	return ok;
+}
 
-fail:
-	e_end(eck);
-	return false;
+
+bool lfht_copy(struct lfht *dst, struct lfht *src) {
+	return lfht_copy_mt(dst, src, 1);
 }
 
 
@@ -1259,7 +2723,8 @@ static int hunt_mig_ptr(
 	for(struct lfht_table *s = get_next(dst); s != NULL; s = get_next(s)) {
 		uintptr_t ptr = mig_ptr(s, dst->gen_id, p_addr);
 		size_t mask = (1ul << s->size_log2) - 1,
-			pos = hash & mask, end = (pos + s->max_probe) & mask;
+			pos = table_hash(s, hash) & mask,
+			end = (pos + s->max_probe) & mask;
 		do {
 			uintptr_t e = atomic_load_explicit(&s->table[pos],
 				memory_order_relaxed);
@@ -1307,6 +2772,8 @@ bool lfht_delval(struct lfht *ht, struct lfht_iter *it, void *p)
 	struct lfht_iter our_it;
 	uintptr_t e, new_e;
 
+	if(it->t == NULL) return it->esc != NULL && esc_del(ht, it->hash, p);
+
 mig_retry:
 	e = atomic_load_explicit(&it->t->table[it->off], memory_order_relaxed);
 	do {
@@ -1364,6 +2831,307 @@ mig_retry:
 }
 
 
+/* swap @old for @new in the escape table. */
+static bool esc_replace(
+	struct lfht *ht, size_t hash, const void *old, void *new)
+{
+	return esc_swap(ht, (struct lfht_hash_pair){ (uintptr_t)old, hash },
+		(struct lfht_hash_pair){ (uintptr_t)new, hash });
+}
+
+
+bool lfht_replace(struct lfht *ht, struct lfht_iter *it, void *old, void *new)
+{
+	assert(e_inside());
+	/* (same as in find_migrated_val().) */
+	assert(it->hash == (*ht->rehash_fn)(new, ht->priv));
+
+	struct lfht_iter our_it;
+	uintptr_t e, new_e;
+
+	if(it->t == NULL) {
+		return it->esc != NULL && esc_replace(ht, it->hash, old, new);
+	}
+
+mig_retry:
+	e = atomic_load_explicit(&it->t->table[it->off], memory_order_relaxed);
+	do {
+		if((e & it->t->mig_bit) != 0) {
+			/* as in lfht_delval(). */
+			if(it != &our_it) {
+				our_it = *it;
+				it = &our_it;
+			}
+			if(mig_gen_id(it->t, e) > 0) {
+				struct lfht_table *tab = it->t;
+				size_t pos;
+				mig_deref(ht, it->hash, &tab, &pos, &e, e);
+				lfht_iter_init(it, tab, it->hash);
+			} else if(!find_migrated_val(ht, it, old)) {
+				return false;
+			}
+			if(it->t == NULL) return esc_replace(ht, it->hash, old, new);
+			goto mig_retry;
+		}
+
+		if(!is_val(it->t, e) || get_raw_ptr(it->t, e) != old) return false;
+
+		/* an entry that's being migrated has a copy elsewhere which would
+		 * keep @old, and @new may not fit this table's common bits; leave
+		 * those to delete-and-add.
+		 */
+		if((e & (it->t->src_bit | it->t->ephem_bit)) != 0
+			|| ((uintptr_t)new & it->t->common_mask) != it->t->common_bits)
+		{
+			goto slow;
+		}
+
+		/* hash bits and the others carry over. */
+		new_e = make_hval(it->t, new, e & it->t->common_mask);
+		assert(is_val(it->t, new_e));
+		if(it->t->hashes != NULL) {
+			/* ordered before the entry by the release below. */
+			atomic_store_explicit(&it->t->hashes[it->off],
+				((struct lfht_hash_pair){ (uintptr_t)new, it->hash }),
+				memory_order_relaxed);
+		}
+	} while(!atomic_compare_exchange_strong_explicit(
+		&it->t->table[it->off], &e, new_e,
+		memory_order_release, memory_order_relaxed));
+
+	return true;
+
+slow:
+	/* add first, so that the key stays visible throughout. the add may have
+	 * moved @old, so look it up again.
+	 */
+	if(!lfht_add(ht, it->hash, new)) return false;
+	if(!lfht_del(ht, it->hash, old)) {
+		/* lost @old to a concurrent delete or replace. */
+		lfht_del(ht, it->hash, new);
+		return false;
+	}
+	return true;
+}
+
+
+/* the first item for @hash in @ht that matches @key per @cmp_fn, in any
+ * table or the escape table, passing over one instance of @skip; so that a
+ * racing call's identical item, as with integer keys, is still found.
+ */
+static void *find_match(
+	struct lfht *ht, size_t hash,
+	bool (*cmp_fn)(const void *cand, void *ptr), const void *key,
+	const void *skip)
+{
+	struct lfht_iter it;
+	for(void *c = lfht_firstval(ht, &it, hash);
+		c != NULL;
+		c = lfht_nextval(ht, &it, hash))
+	{
+		if(c == skip) skip = NULL;
+		else if((*cmp_fn)(c, (void *)key)) return c;
+	}
+	return NULL;
+}
+
+
+/* helps migration into @ht's main table along until it has no secondaries,
+ * up to one claim per MIG_CLAIM slots in those there were to begin with.
+ * stores the main table in *@tab_p. returns false when secondaries remain,
+ * because they're halted or because other threads' claims are in flight.
+ */
+static bool settle_main(struct lfht *ht, struct lfht_table **tab_p)
+{
+	struct lfht_table *tab = *tab_p;
+	size_t budget = 0;
+	for(struct lfht_table *t = get_next(tab); t != NULL; t = get_next(t)) {
+		budget += ((1ul << t->size_log2) + MIG_CLAIM - 1) / MIG_CLAIM;
+	}
+	while(get_next(tab) != NULL && budget-- > 0
+		&& lfht_migrate_assist(ht, 1))
+	{
+		tab = get_main(ht);
+	}
+	*tab_p = get_main(ht);
+	return get_next(*tab_p) == NULL;
+}
+
+
+/* lfht_add_unique()'s fused probe of @tab: compares each candidate for
+ * @hash against @key up to the first void slot, and stores @p there. void
+ * slots are only ever filled once, so of two calls adding equal items to
+ * @tab, the one that stores farther along the probe has passed the other's
+ * item on the way and returns -EEXIST instead.
+ *
+ * returns 0 when @p was added, -EEXIST when a match was found, -ENOSPC when
+ * there was no void slot within @tab->max_probe, and -EAGAIN when @tab is
+ * being migrated out of.
+ */
+static int ht_add_unique(
+	struct lfht *ht, struct lfht_table *tab, size_t hash,
+	bool (*cmp_fn)(const void *cand, void *ptr), const void *key, void *p,
+	void **found_p)
+{
+	assert(((uintptr_t)p & tab->common_mask) == tab->common_bits);
+
+	size_t mask = (1ul << tab->size_log2) - 1,
+		pos = table_hash(tab, hash) & mask;
+	uintptr_t h2 = get_hash_ptr_bits(tab, hash), perfect = tab->perfect_bit;
+	for(size_t i = 0; i < tab->max_probe; i++) {
+		uintptr_t e = atomic_load_explicit(&tab->table[pos],
+			memory_order_relaxed);
+retry:
+		if((e & (tab->mig_bit | tab->src_bit)) != 0) return -EAGAIN;
+		if(e == 0) {
+			uintptr_t hval = make_hval(tab, p, h2 | perfect);
+			assert(is_val(tab, hval));
+			if(tab->ctrl != NULL) ctrl_mark(tab, pos, ctrl_tag(hash));
+			if(tab->hashes != NULL) {
+				atomic_store_explicit(&tab->hashes[pos],
+					((struct lfht_hash_pair){ (uintptr_t)p, hash }),
+					memory_order_relaxed);
+			}
+			if(!atomic_compare_exchange_strong_explicit(&tab->table[pos],
+				&e, hval, memory_order_release, memory_order_relaxed))
+			{
+				/* snatched; see what by. */
+				goto retry;
+			}
+			atomic_fetch_add_explicit(&ELEMS(tab), 1, memory_order_relaxed);
+			PROBE_HIST(tab, LFHT_PROBE_ADD, hash, pos);
+			return 0;
+		}
+		if(is_val(tab, e) && get_extra_ptr_bits(tab, e) == (h2 | perfect)
+			&& (likely((ht->flags & LFHT_CHECK_HASH) == 0)
+				|| !hash_differs(tab, pos, e, hash)))
+		{
+			void *c = get_raw_ptr(tab, e);
+			if((*cmp_fn)(c, (void *)key)) {
+				if(found_p != NULL) *found_p = c;
+				return -EEXIST;
+			}
+		}
+		pos = (pos + 1) & mask;
+		perfect = 0;
+	}
+	return -ENOSPC;
+}
+
+
+/* spins for *@spins_p rounds, or twice that when @higher, before a call
+ * that backed out of a race goes again; and doubles *@spins_p for next time,
+ * up to ADD_UNIQUE_MAX_SPINS. two calls that each saw the other's item back
+ * out alike, so the one whose item is the lower goes again first and likely
+ * gets through alone, and the other then finds its item.
+ */
+#define ADD_UNIQUE_MAX_SPINS 4096
+
+static void add_unique_backoff(unsigned *spins_p, bool higher)
+{
+	for(unsigned i = 0, n = *spins_p << higher; i < n; i++) {
+#ifdef __x86_64__
+		__builtin_ia32_pause();
+#else
+		atomic_signal_fence(memory_order_seq_cst);
+#endif
+	}
+	if(*spins_p < ADD_UNIQUE_MAX_SPINS) *spins_p *= 2;
+}
+
+
+/* one go at lfht_add_unique(). -EAGAIN means go again. */
+static int add_unique_once(
+	struct lfht *ht, size_t hash,
+	bool (*cmp_fn)(const void *cand, void *ptr), const void *key, void *p,
+	void **found_p, unsigned *spins_p)
+{
+	struct lfht_table *tab = get_main(ht);
+	if(tab == NULL) {
+		tab = first_table(ht, p);
+		if(tab == NULL) return -ENOMEM;
+	}
+
+	/* with no secondaries and nothing escaped, every item is in @tab where
+	 * ht_add_unique() looks; otherwise, and where @p won't go there either,
+	 * look everywhere first.
+	 */
+	bool settled = settle_main(ht, &tab),
+		conforms = ((uintptr_t)p & tab->common_mask) == tab->common_bits,
+		escaped = !conforms && !can_remask(tab, p);
+	if(!settled || escaped
+		|| atomic_load_explicit(&ht->n_escaped, memory_order_relaxed) > 0)
+	{
+		void *c = find_match(ht, hash, cmp_fn, key, NULL);
+		if(c != NULL) {
+			if(found_p != NULL) *found_p = c;
+			return -EEXIST;
+		}
+	}
+
+	if(escaped) {
+		if(!esc_add(ht, hash, p)) return -ENOMEM;
+	} else if(!conforms) {
+		return remask_table(ht, tab, p) != NULL ? -EAGAIN : -ENOMEM;
+	} else {
+		int d = ht_full_test(ht, tab);
+		if(d == -1) {
+			rehash_table(ht, tab);
+			return -EAGAIN;
+		} else if(d == -2) {
+			resize_table(ht, tab, tab->size_log2 - 1);
+			return -EAGAIN;
+		} else if(d > 0) {
+			return double_table(ht, tab, p) != NULL ? -EAGAIN : -ENOMEM;
+		}
+
+		int n = ht_add_unique(ht, tab, hash, cmp_fn, key, p, found_p);
+		if(n == -ENOSPC) {
+			return double_table(ht, tab, p) != NULL ? -EAGAIN : -ENOMEM;
+		}
+		if(n != 0) return n;
+	}
+
+	/* a racing call may have put its item where the probe above didn't
+	 * look: into another table while @tab wasn't settled, or into the escape
+	 * table. the fence orders each one's store before its look, so at least
+	 * one of the two sees the other's item, backs its own out, and goes
+	 * again. neither can tell whether the other saw it too, or went ahead
+	 * with its own; so one that sees must yield even where its item is the
+	 * lower, and only the backoff breaks the tie where both do. (@p seen
+	 * twice mid-migration costs a needless go.)
+	 */
+	atomic_thread_fence(memory_order_seq_cst);
+	if(!escaped && settled && get_main(ht) == tab && get_next(tab) == NULL
+		&& atomic_load_explicit(&ht->n_escaped, memory_order_relaxed) == 0)
+	{
+		return 0;
+	}
+	void *c = find_match(ht, hash, cmp_fn, key, p);
+	if(c != NULL) {
+		lfht_del(ht, hash, p);
+		add_unique_backoff(spins_p, (uintptr_t)p > (uintptr_t)c);
+		return -EAGAIN;
+	}
+	return 0;
+}
+
+
+int lfht_add_unique(
+	struct lfht *ht, size_t hash,
+	bool (*cmp_fn)(const void *cand, void *ptr), const void *key, void *p,
+	void **found_p)
+{
+	int eck = e_begin(), n;
+	unsigned spins = 16;
+	do {
+		n = add_unique_once(ht, hash, cmp_fn, key, p, found_p, &spins);
+	} while(n == -EAGAIN);
+	e_end(eck);
+	return n;
+}
+
+
 bool lfht_del(struct lfht *ht, size_t hash, const void *p)
 {
 	int eck = e_begin();
@@ -1410,14 +3178,10 @@ static struct lfht_table *next_table_gen(
 }
 
 
-void *lfht_firstval(struct lfht *ht, struct lfht_iter *it, size_t hash)
+/* returns the oldest table in @ht, or NULL if there are none. */
+static struct lfht_table *get_oldest(struct lfht *ht)
 {
-	assert(e_inside());
-
-	struct lfht_table *tab = get_main(ht);
-	if(tab == NULL) return NULL;
-
-	/* get the very last table. */
+	struct lfht_table *tab = NULL;
 	struct nbsl_iter i;
 	for(struct nbsl_node *cur = nbsl_first(&ht->tables, &i);
 		cur != NULL;
@@ -1425,7 +3189,15 @@ void *lfht_firstval(struct lfht *ht, struct lfht_iter *it, size_t hash)
 	{
 		tab = container_of(cur, struct lfht_table, link);
 	}
+	return tab;
+}
 
+
+/* lfht_firstval() starting from @tab, which should be the oldest table. */
+static void *firstval_from(
+	struct lfht *ht, struct lfht_iter *it, struct lfht_table *tab,
+	size_t hash)
+{
 	lfht_iter_init(it, tab, hash);
 	for(;;) {
 		void *val = ht_val(ht, it, hash);
@@ -1433,18 +3205,41 @@ void *lfht_firstval(struct lfht *ht, struct lfht_iter *it, size_t hash)
 		else {
 			/* next table plz */
 			tab = next_table_gen(ht, it->t, false);
-			if(tab == NULL) return NULL;
+			if(tab == NULL) return esc_firstval(ht, it, hash);
 			lfht_iter_init(it, tab, hash);
 		}
 	}
 }
 
 
+void *lfht_firstval(struct lfht *ht, struct lfht_iter *it, size_t hash)
+{
+	assert(e_inside());
+
+	struct lfht_table *main = get_main(ht);
+	if(main == NULL) return esc_firstval(ht, it, hash);
+	if((ht->flags & LFHT_READ_MIGRATE) != 0 && get_next(main) != NULL) {
+		ht_migrate(ht, main);
+	}
+
+	/* get the very last table. */
+	return firstval_from(ht, it, get_oldest(ht), hash);
+}
+
+
 void *lfht_nextval(struct lfht *ht, struct lfht_iter *it, size_t hash)
 {
 	assert(e_inside());
 
-	if(unlikely(it->t == NULL)) return NULL;
+	if(unlikely(it->t == NULL)) {
+		/* in the escape table, or past it. */
+		if(it->esc == NULL) return NULL;
+		it->off = (it->off + 1) & ((1ul << it->esc->size_log2) - 1);
+		if(it->off == it->end && !esc_start(it, it->esc->next, hash)) {
+			return NULL;
+		}
+		return esc_val(it, hash);
+	}
 
 	/* next offset in same table. */
 	it->perfect = 0;
@@ -1459,7 +3254,7 @@ void *lfht_nextval(struct lfht *ht, struct lfht_iter *it, size_t hash)
 	/* go to next table, etc. */
 	do {
 		struct lfht_table *tab = next_table_gen(ht, it->t, false);
-		if(tab == NULL) return NULL;
+		if(tab == NULL) return esc_firstval(ht, it, hash);
 		lfht_iter_init(it, tab, hash);
 		ptr = ht_val(ht, it, hash);
 	} while(ptr == NULL);
@@ -1468,37 +3263,115 @@ void *lfht_nextval(struct lfht *ht, struct lfht_iter *it, size_t hash)
 }
 
 
-void *lfht_first(struct lfht *ht, struct lfht_iter *it)
+size_t lfht_get_batch(
+	struct lfht *ht, const size_t hashes[],
+	bool (*cmp_fn)(const void *cand, void *ptr), void *const keys[],
+	void *out[], size_t n)
 {
 	assert(e_inside());
 
-	/* find oldest table. */
-	struct lfht_table *tab = NULL;
-	struct nbsl_iter i;
-	for(struct nbsl_node *cur = nbsl_first(&ht->tables, &i);
-		cur != NULL;
-		cur = nbsl_next(&ht->tables, &i))
-	{
-		tab = container_of(cur, struct lfht_table, link);
+	size_t found = 0;
+	for(size_t base = 0; base < n; base += LFHT_BATCH_CHUNK) {
+		size_t m = n - base < LFHT_BATCH_CHUNK ? n - base : LFHT_BATCH_CHUNK;
+		const size_t *hs = &hashes[base];
+		void **res = &out[base];
+
+		struct lfht_table *main = get_main(ht);
+		if((ht->flags & LFHT_READ_MIGRATE) != 0
+			&& main != NULL && get_next(main) != NULL)
+		{
+			/* once per chunk. */
+			ht_migrate(ht, main);
+		}
+		struct lfht_table *oldest = get_oldest(ht);
+		if(main == NULL || oldest == NULL) {
+			memset(res, 0, (n - base) * sizeof *res);
+			break;
+		}
+
+		/* fetch the initial slot of each probe sequence: in the oldest table
+		 * where lfht_firstval() starts, and in the main table where it'll
+		 * likely end up.
+		 */
+		size_t omask = (1ul << oldest->size_log2) - 1,
+			mmask = (1ul << main->size_log2) - 1;
+		for(size_t i = 0; i < m; i++) {
+			__builtin_prefetch(&oldest->table[table_hash(oldest, hs[i]) & omask]);
+			if(main != oldest) {
+				__builtin_prefetch(&main->table[table_hash(main, hs[i]) & mmask]);
+			}
+		}
+
+		/* find the first candidate for each, and fetch those. */
+		struct lfht_iter its[LFHT_BATCH_CHUNK];
+		for(size_t i = 0; i < m; i++) {
+			res[i] = firstval_from(ht, &its[i], oldest, hs[i]);
+			if(res[i] != NULL) __builtin_prefetch(res[i]);
+		}
+
+		/* resolve. */
+		for(size_t i = 0; i < m; i++) {
+			void *cand = res[i];
+			while(cand != NULL && !(*cmp_fn)(cand, keys[base + i])) {
+				cand = lfht_nextval(ht, &its[i], hs[i]);
+			}
+			res[i] = cand;
+			if(cand != NULL) found++;
+		}
 	}
+
+	return found;
+}
+
+
+void *lfht_first(struct lfht *ht, struct lfht_iter *it)
+{
+	assert(e_inside());
+
+	struct lfht_table *tab = get_oldest(ht);
 	if(tab == NULL) {
-		it->t = NULL;
-		return NULL;
+		*it = (struct lfht_iter){
+			.esc = atomic_load_explicit(&ht->esc, memory_order_acquire),
+		};
+	} else {
+		*it = (struct lfht_iter){
+			.t = tab, .end = (1ul << tab->size_log2) - 1,
+		};
 	}
-	*it = (struct lfht_iter){ .t = tab, .end = (1ul << tab->size_log2) - 1 };
 	return lfht_next(ht, it);
 }
 
 
+/* lfht_next() over the escape table's generations. */
+static void *esc_next(struct lfht_iter *it)
+{
+	for(; it->esc != NULL; it->esc = it->esc->next, it->off = 0) {
+		for(; it->off < (1ul << it->esc->size_log2); it->off++) {
+			struct lfht_hash_pair hp = atomic_load_explicit(
+				&it->esc->slots[it->off], memory_order_acquire);
+			if(hp.ptr > ESC_TOMB) {
+				it->off++;
+				return (void *)hp.ptr;
+			}
+		}
+	}
+	return NULL;
+}
+
+
 void *lfht_next(struct lfht *ht, struct lfht_iter *it)
 {
 	assert(e_inside());
-	if(unlikely(it->t == NULL)) return NULL;
+	if(unlikely(it->t == NULL)) return esc_next(it);
 
 	for(;;) {
 		if(it->off == it->end + 1) {
 			it->t = next_table_gen(ht, it->t, false);
-			if(it->t == NULL) return NULL;
+			if(it->t == NULL) {
+				it->off = 0;
+				it->esc = atomic_load_explicit(&ht->esc, memory_order_acquire);
+				return esc_next(it);
+			}
 			it->off = 0;
 			it->end = (1ul << it->t->size_log2) - 1;
 		}
@@ -1508,3 +3381,78 @@ void *lfht_next(struct lfht *ht, struct lfht_iter *it)
 		if(is_val(it->t, e)) return get_raw_ptr(it->t, e);
 	}
 }
+
+
+static void table_stats(
+	struct lfht *ht, struct lfht_table *t, struct lfht_table_stats *st)
+{
+	*st = (struct lfht_table_stats){
+		.size_log2 = t->size_log2, .gen_id = t->gen_id,
+		.halt_gen_id = atomic_load_explicit(&t->halt_gen_id,
+			memory_order_relaxed),
+	};
+	get_totals(&st->elems, &st->deleted, &st->mig_left, t);
+
+	size_t mask = (1ul << t->size_log2) - 1;
+	for(size_t i = 0; i <= mask; i++) {
+		uintptr_t e = atomic_load_explicit(&t->table[i],
+			memory_order_relaxed);
+		if((e & t->mig_bit) != 0) {
+			if(e == mig_void(t) || e == mig_val(t)) st->migrated++;
+			else st->mig_ptrs++;
+			continue;
+		}
+		if((e & t->hazard_bit) != 0) st->hazards++;
+		if(is_empty(t, e)) {
+			if(e != 0 && (e & t->del_bit) != 0) st->tombstones++;
+		} else if(is_val(t, e)) {
+			st->values++;
+			size_t hash = slot_hash(ht, t, i, get_raw_ptr(t, e)),
+				dist = (i - table_hash(t, hash)) & mask;
+			if(dist > st->max_probe) st->max_probe = dist;
+		}
+	}
+	for(size_t i = 0; i < mig_done_words(t->size_log2); i++) {
+		uint16_t s = atomic_load_explicit(&t->mig_done[i],
+			memory_order_relaxed);
+		if((s & MIG_BLOCK_DONE) != 0) st->done_blocks++;
+	}
+}
+
+
+void lfht_stats(struct lfht *ht, struct lfht_stats *out)
+{
+	assert(e_inside());
+
+	out->n_tables = 0;
+	out->n_escaped = atomic_load_explicit(&ht->n_escaped,
+		memory_order_relaxed);
+	for(struct lfht_table *t = get_main(ht); t != NULL; t = get_next(t)) {
+		if(out->n_tables < LFHT_STATS_MAX_TABLES) {
+			table_stats(ht, t, &out->tables[out->n_tables]);
+		}
+		out->n_tables++;
+	}
+}
+
+
+bool lfht_probe_hist(struct lfht *ht, struct lfht_probe_hist *out)
+{
+	*out = (struct lfht_probe_hist){ };
+#ifdef LFHT_PROBE_HIST
+	for(struct lfht_table *t = get_main(ht); t != NULL; t = get_next(t)) {
+		for(int i = 0; i < t->pc->n_buckets; i++) {
+			struct lfht_table_percpu *pc = percpu_get(t->pc, i);
+			for(int k = 0; k < LFHT_PROBE_N_KINDS; k++) {
+				for(int b = 0; b < LFHT_PROBE_HIST_BUCKETS; b++) {
+					out->counts[k][b] += atomic_load_explicit(
+						&PROBE_HIST_OF(pc)[k][b], memory_order_relaxed);
+				}
+			}
+		}
+	}
+	return true;
+#else
+	return false;
+#endif
+}
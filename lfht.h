@@ -15,6 +15,22 @@
 
 #define CACHELINE_ALIGN __attribute__((aligned(64)))
 
+/* flags for lfht_init_ext(). */
+#define LFHT_STORE_HASH 1	/* keep hashes for migration; see below */
+#define LFHT_CHECK_HASH 2	/* ... and check them in lookups */
+#define LFHT_CTRL_BYTES 4	/* per-slot tag bytes for lookups */
+#define LFHT_READ_MIGRATE 8	/* lookups help migration along */
+
+
+/* under LFHT_STORE_HASH, the hash given for an entry's value, stored at the
+ * same index as the entry. valid iff ptr matches the entry's raw pointer.
+ */
+struct lfht_hash_pair
+{
+	uintptr_t ptr;
+	size_t hash;
+} __attribute__((aligned(16)));
+
 
 struct lfht_table
 {
@@ -27,6 +43,9 @@ struct lfht_table
 
 	/* constants */
 	_Atomic uintptr_t *table CACHELINE_ALIGN;	/* allocated separately */
+	_Atomic struct lfht_hash_pair *hashes;	/* same, or NULL */
+	_Atomic uint8_t *ctrl;		/* same, or NULL */
+	_Atomic uint16_t *mig_done;	/* same; summary per block of slots */
 	struct percpu *pc;			/* of <struct lfht_table_percpu> */
 	/* common_mask indicates bits that're the same across all keys;
 	 * common_bits specifies what those bits are.
@@ -71,9 +90,19 @@ struct lfht_table
 	size_t max, max_with_deleted, max_probe;
 	unsigned short size_log2;	/* 1 << size_log2 < SSIZE_MAX */
 	unsigned short probe_addr_size_log2;
+	unsigned short keep_log2;	/* no shrinking below; see lfht_reserve() */
+	size_t seed;			/* see lfht_rehash() */
 };
 
 
+/* kinds and buckets of the probe length histogram; see lfht_probe_hist(). */
+#define LFHT_PROBE_ADD 0
+#define LFHT_PROBE_HIT 1
+#define LFHT_PROBE_MISS 2
+#define LFHT_PROBE_N_KINDS 3
+#define LFHT_PROBE_HIST_BUCKETS 20
+
+
 struct lfht_table_percpu
 {
 	_Atomic size_t elems, deleted;	/* split-sum counters */
@@ -99,6 +128,16 @@ struct lfht
 	size_t (*rehash_fn)(const void *ptr, void *priv);
 	void *priv;
 	unsigned int first_size_log2;	/* size of first table */
+	unsigned int flags;				/* LFHT_* */
+
+	_Atomic size_t seed;	/* for new tables; see lfht_rehash() */
+	_Atomic unsigned int reserve_log2;	/* same; see lfht_reserve() */
+
+	/* items that no table's common_mask could accommodate; see lfht.c */
+	struct lfht_esc *_Atomic esc;
+	_Atomic size_t n_escaped;
+
+	struct lfht_migrator *_Atomic migrator;	/* or NULL */
 };
 
 
@@ -115,8 +154,79 @@ extern void lfht_init_sized(
 	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv,
 	size_t size);
 
+/* makes room for @n items in total, without resizes in between. on a live
+ * @ht, installs a main table of that size in one step when the current one
+ * is smaller; on one without tables, raises the size of the first table until
+ * lfht_clear(). that table, and those replacing it at the same size, won't be
+ * shrunk so that the reservation isn't undone while it's being filled; past
+ * the next doubling it's forgotten. returns false if malloc fails.
+ */
+extern bool lfht_reserve(struct lfht *ht, size_t n);
+
+/* same as lfht_init_sized(), but with @flags. @size may be 0 for the
+ * default.
+ *
+ * LFHT_STORE_HASH keeps the hash of each entry in a side array of each table,
+ * written with a 16-byte atomic store before the entry itself. migration then
+ * takes the hash from there rather than calling @rehash_fn, sparing a cache
+ * miss on the item and the cost of hashing its key, at 16 bytes per slot. the
+ * hash is only used when its pointer matches the entry, so @rehash_fn remains
+ * a fallback and must still be given.
+ *
+ * LFHT_CHECK_HASH implies LFHT_STORE_HASH, and has lookups compare the stored
+ * hash of each candidate with the hash looked for, so that entries whose
+ * in-slot hash bits match by accident are skipped instead of being handed to
+ * the caller's comparison function. this costs a 16-byte atomic load per
+ * candidate, and pays off when the keys are expensive to compare or few hash
+ * bits fit in the slots (see t/13_lfht_badhash.c).
+ *
+ * LFHT_CTRL_BYTES gives each table an array of one byte per slot, which holds
+ * a 7-bit tag from the top of the hash of whatever was last written into the
+ * slot, or a value that says "never written" or "many". lookups scan these 16
+ * at a time and only examine slots with a matching or wildcard tag, stopping
+ * at the first one never written; so a negative lookup reads one byte per
+ * slot where a scan of the slots would read eight, i.e. an eighth of the
+ * memory, plus whichever slots have a matching tag. costs one byte per slot
+ * and a byte-CAS per insert.
+ *
+ * LFHT_READ_MIGRATE has lfht_firstval() and lfht_get_batch() do the same
+ * small amount of migration that follows each add, whenever there's a
+ * secondary table. this drains old tables under read-mostly loads, where
+ * they'd otherwise linger and make every lookup probe each generation, at the
+ * cost of writes in the read path while migration is in progress.
+ */
+extern void lfht_init_ext(
+	struct lfht *ht,
+	size_t (*rehash_fn)(const void *ptr, void *priv), void *priv,
+	size_t size, unsigned int flags);
+
 extern void lfht_clear(struct lfht *ht);
-/* TODO: lfht_copy(), lfht_rehash() */
+
+/* initializes @dst as a clone of @src, with the same hash function, flags
+ * and initial size, and its items in a single table sized to fit them.
+ * lfht_copy_mt() splits the work of reading @src and filling the new table
+ * across @n_threads threads, including the caller. @src may be in use
+ * meanwhile, and migrated too: the copy is a point-in-time snapshot with the
+ * same weak consistency as lfht_first() and lfht_next(), so items added or
+ * deleted while it's being made may or may not be in @dst, and those present
+ * throughout are there once each wherever migration moves them. items that
+ * had to go around @src's tables (see the escape table in lfht.c) rejoin them
+ * in @dst where they fit. returns false, leaving @dst empty, if malloc fails.
+ */
+extern bool lfht_copy(struct lfht *dst, struct lfht *src);
+extern bool lfht_copy_mt(struct lfht *dst, struct lfht *src, int n_threads);
+
+/* replaces @ht's main table with one that scrambles the caller's hashes with
+ * @seed before deriving positions and match bits from them, and migrates
+ * items into it like any rehash. tables made afterward inherit the seed. this
+ * breaks up clustering and collisions in the low bits of hashes, such as
+ * those of a flooding attack on one table's layout, without a change of hash
+ * function or any writers having to stop; but items whose full hashes
+ * collide stay collided. seed 0 means no scrambling, which is the default.
+ * returns false if malloc fails, leaving the main table as it was; though
+ * tables made afterward still take @seed.
+ */
+extern bool lfht_rehash(struct lfht *ht, size_t seed);
 
 
 /* valid for lfht_del_at() iff ->off != ->end, or rather,
@@ -126,6 +236,7 @@ struct lfht_iter {
 	struct lfht_table *t;
 	size_t off, end, hash;
 	uintptr_t perfect;
+	struct lfht_esc *esc;	/* when ->t == NULL */
 };
 
 #define LFHT_ADD_ITER(hash_) ((struct lfht_iter){ .hash = (hash_) })
@@ -146,8 +257,44 @@ static inline bool lfht_add(struct lfht *ht, size_t hash, void *p) {
 	return lfht_add_many(ht, &it, p);
 }
 
+/* add @n items at once, where @ptrs[i] hashes to @hashes[i]. the items are
+ * stored directly into a new table sized for them and whatever @ht held
+ * before, which is then installed as the main table; so loading a large set
+ * into an empty lfht costs a single pass rather than a series of doublings
+ * and migrations. returns false on malloc failure, in which case nothing was
+ * added; though where some of @ptrs had to be added one at a time, those that
+ * went in before the failure are deleted again, and concurrent lookups may
+ * have seen them in the meantime.
+ */
+extern bool lfht_add_bulk(
+	struct lfht *ht, const size_t hashes[], void *const ptrs[], size_t n);
+
 extern bool lfht_del(struct lfht *ht, size_t hash, const void *p);
 
+/* adds @p under @hash unless an item matching @key per @cmp_fn is already
+ * there. returns 0 if @p was added; -EEXIST if an item was found, which is
+ * stored in *@found_p unless that's NULL; and -ENOMEM on malloc failure.
+ * concurrent calls for the same key add it at most once, without locking:
+ * each first helps any migration into the main table to completion, then
+ * probes it for a match and stores @p into the first void slot on the way,
+ * which a racing call for the same key then can't get past without seeing
+ * @p. where the main table couldn't be settled that way, or @p goes to the
+ * escape table, the call looks for a racing item after storing @p, and backs
+ * @p out and goes again if there is one. so there, @p may be seen for a
+ * moment, and even handed to a third call as its *@found_p just before it's
+ * backed out; two calls that each see the other's item both back out,
+ * leaving the key absent until one of them goes again; and as they may keep
+ * doing so, progress is only obstruction-free, with a backoff between goes
+ * that grows each time, and is longer for the call whose @p is the higher,
+ * to make that unlikely to last. items added with lfht_add() in the meantime
+ * may still be duplicated. the item found has the same epoch rules as
+ * lfht_get()'s return value.
+ */
+extern int lfht_add_unique(
+	struct lfht *ht, size_t hash,
+	bool (*cmp_fn)(const void *cand, void *ptr), const void *key, void *p,
+	void **found_p);
+
 /* convenience function for retrieving the first matching item. caller must
  * have an existing epoch bracket, or the returned pointer will be invalid and
  * iteration will go into undefined la-la land.
@@ -166,11 +313,191 @@ static inline void *lfht_get(
 	return NULL;
 }
 
+/* batched form of lfht_get(). stores the first item matching @keys[i] per
+ * @cmp_fn under @hashes[i] into @out[i], or NULL if there is none, and returns
+ * the number of items found. the initial probe slots and candidate items of
+ * up to LFHT_BATCH_CHUNK lookups are prefetched before any of them are
+ * compared, so that their cache misses overlap. same epoch rules as
+ * lfht_get().
+ */
+#define LFHT_BATCH_CHUNK 16
+
+extern size_t lfht_get_batch(
+	struct lfht *ht, const size_t hashes[],
+	bool (*cmp_fn)(const void *cand, void *ptr), void *const keys[],
+	void *out[], size_t n);
+
 extern void *lfht_first(struct lfht *ht, struct lfht_iter *it);
 extern void *lfht_next(struct lfht *ht, struct lfht_iter *it);
 
 /* returns true if @p was deleted, false otherwise. */
 extern bool lfht_delval(struct lfht *ht, struct lfht_iter *it, void *p);
 
+/* replaces @old, found at @it, with @new, which must have the same hash. in
+ * the usual case this is a single compare-and-swap on @old's slot, leaving
+ * no tombstone, and lookups see either item and never neither. where @old is
+ * being migrated, or @new doesn't fit the table's common bits, @new is added
+ * and @old deleted instead, so that both may be seen for a moment. returns
+ * true if @old was replaced, and false if it wasn't there or adding @new
+ * failed, in which case @ht is left as it was.
+ */
+extern bool lfht_replace(
+	struct lfht *ht, struct lfht_iter *it, void *old, void *new);
+
+
+/* integer-key set mode. lfht_int_init() sets @ht up with the given @flags for
+ * use with the lfht_int_*() functions below, which store each key in a slot
+ * as though it were a pointer rather than pointing to an object allocated to
+ * hold it. the hash is lfht_int_hash() of the key; lookups compare slot
+ * contents rather than calling a cmp_fn, and migration recomputes hashes from
+ * the slot without a call through rehash_fn or a cache miss on an item. keys
+ * may be up to LFHT_INT_KEY_MAX; the functions below return false for any
+ * greater. dense or clustered keys keep enough bits in common for the slot
+ * format; ones that don't go to the escape table like any other item would.
+ *
+ * this is a set: a key is either present or not, and there's no value stored
+ * alongside. a map from integer keys keeps its values in items as usual.
+ *
+ * lfht_first() and lfht_next() work as usual, and their return values turn
+ * back into keys with lfht_int_key(). like lfht_add(), lfht_int_add() doesn't
+ * check whether @key was already present; lfht_int_add_unique() does, and
+ * returns false if it was, or on malloc failure. same epoch rules as
+ * lfht_get().
+ */
+#define LFHT_INT_KEY_MAX (UINTPTR_MAX >> 5)
+
+extern void lfht_int_init(struct lfht *ht, size_t size, unsigned int flags);
+
+/* one step of splitmix64. the offset keeps key 0 from hashing to 0, which
+ * would make its slots look empty.
+ */
+static inline size_t lfht_int_hash(uintptr_t key) {
+	uint64_t x = key + 0x9e3779b97f4a7c15ull;
+	x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+	x ^= x >> 27; x *= 0x94d049bb133111ebull;
+	return (size_t)(x ^ (x >> 31));
+}
+
+/* the low bits are constant, as they would be in malloc'd pointers, and
+ * never all zero.
+ */
+static inline void *lfht_int_ptr(uintptr_t key) {
+	return (void *)((key << 5) | 0x10);
+}
+
+static inline uintptr_t lfht_int_key(const void *p) {
+	return (uintptr_t)p >> 5;
+}
+
+static inline bool lfht_int_add(struct lfht *ht, uintptr_t key) {
+	if(key > LFHT_INT_KEY_MAX) return false;
+	return lfht_add(ht, lfht_int_hash(key), lfht_int_ptr(key));
+}
+
+static inline bool lfht_int_del(struct lfht *ht, uintptr_t key) {
+	if(key > LFHT_INT_KEY_MAX) return false;
+	return lfht_del(ht, lfht_int_hash(key), lfht_int_ptr(key));
+}
+
+static inline bool lfht_int_cmp_(const void *cand, void *key) {
+	return cand == key;
+}
+
+static inline bool lfht_int_add_unique(struct lfht *ht, uintptr_t key) {
+	if(key > LFHT_INT_KEY_MAX) return false;
+	void *p = lfht_int_ptr(key);
+	return lfht_add_unique(ht, lfht_int_hash(key), &lfht_int_cmp_, p, p,
+		NULL) == 0;
+}
+
+static inline bool lfht_int_get(struct lfht *ht, uintptr_t key)
+{
+	if(key > LFHT_INT_KEY_MAX) return false;
+	size_t hash = lfht_int_hash(key);
+	void *p = lfht_int_ptr(key);
+	struct lfht_iter it;
+	for(void *cand = lfht_firstval(ht, &it, hash);
+		cand != NULL;
+		cand = lfht_nextval(ht, &it, hash))
+	{
+		if(cand == p) return true;
+	}
+	return false;
+}
+
+
+/* introspection. lfht_stats() fills in @out with one entry per table in
+ * @ht, main table first, up to LFHT_STATS_MAX_TABLES of them; n_tables is
+ * the total number of tables regardless. the values are a snapshot taken
+ * without stopping concurrent access, so they're only approximately
+ * consistent with one another. it reads tables that a concurrent migration
+ * may free, and calls rehash_fn to find probe lengths, so it has the same
+ * epoch rules as lfht_get(); debug builds assert as much.
+ */
+#define LFHT_STATS_MAX_TABLES 8
+
+struct lfht_table_stats
+{
+	unsigned short size_log2;
+	unsigned long gen_id, halt_gen_id;
+	size_t elems, deleted, mig_left;	/* from the split-sum counters */
+	size_t max_probe;	/* longest distance of a value from its home slot */
+	/* slot counts by type. values are what lookups may return, tombstones
+	 * are deleted slots that ht_add() may reuse, mig_ptrs are forwarding
+	 * entries of migration in progress, and migrated are slots whose
+	 * migration has finished. hazards overlap with the others.
+	 */
+	size_t values, tombstones, mig_ptrs, migrated, hazards;
+	size_t done_blocks;	/* blocks lookups skip as migrated in full */
+};
+
+struct lfht_stats
+{
+	size_t n_tables;
+	size_t n_escaped;	/* items in the escape table, not counted above */
+	struct lfht_table_stats tables[LFHT_STATS_MAX_TABLES];
+};
+
+extern void lfht_stats(struct lfht *ht, struct lfht_stats *out);
+
+/* does up to @budget steps of the migration work that follows each add, where
+ * a step examines up to LFHT_MIG_CLAIM adjacent slots of a secondary table.
+ * returns true if there's migration left that it could do, i.e. a secondary
+ * table remains whose migration hasn't halted. caller must be inside an epoch
+ * bracket.
+ */
+#define LFHT_MIG_CLAIM 8
+
+extern bool lfht_migrate_assist(struct lfht *ht, size_t budget);
+
+/* a thread that calls lfht_migrate_assist() on @ht until there's nothing left
+ * to migrate, then sleeps until the next resize wakes it. one per lfht.
+ * lfht_migrator_start() returns NULL on failure. the migrator must be stopped
+ * before @ht is cleared.
+ */
+#define LFHT_MIGRATOR_BUDGET 256
+
+struct lfht_migrator;
+
+extern struct lfht_migrator *lfht_migrator_start(struct lfht *ht);
+extern void lfht_migrator_stop(struct lfht_migrator *m);
+
+/* probe length histogram, when lfht.c is built with -DLFHT_PROBE_HIST.
+ * counts[LFHT_PROBE_ADD] are the distances from the home slot at which
+ * entries were added, incl. copies made by migration, [LFHT_PROBE_HIT] those
+ * at which lookups found a candidate item, and [LFHT_PROBE_MISS] those at
+ * which lookups ran out of slots to examine in one table. bucket 0 is for
+ * distance 0 and bucket i > 0 for distances in [2^(i-1), 2^i), with the last
+ * bucket taking everything beyond. sums over all CPUs and the tables
+ * currently in @ht; counts of tables that've since been migrated out are
+ * lost. returns false, and zeroes @out, if the histogram wasn't built in.
+ */
+struct lfht_probe_hist
+{
+	size_t counts[LFHT_PROBE_N_KINDS][LFHT_PROBE_HIST_BUCKETS];
+};
+
+extern bool lfht_probe_hist(struct lfht *ht, struct lfht_probe_hist *out);
+
 
 #endif
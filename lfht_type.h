@@ -0,0 +1,112 @@
+
+#ifndef LFHT_TYPE_H
+#define LFHT_TYPE_H
+
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "lfht.h"
+
+
+/* typed front-end to lfht, after ccan's htable_type. LFHT_DEFINE_TYPE(name,
+ * type, keyof, hashfn, eqfn) defines struct name, which holds a struct lfht
+ * of pointers to @type, and static inline functions over it:
+ *
+ *   void name_init(struct name *ht);
+ *   void name_init_sized(struct name *ht, size_t size);
+ *   void name_init_ext(struct name *ht, size_t size, unsigned int flags);
+ *   void name_clear(struct name *ht);
+ *   bool name_add(struct name *ht, type *p);
+ *   bool name_del(struct name *ht, const type *p);
+ *   type *name_get(struct name *ht, key k);
+ *   bool name_delkey(struct name *ht, key k);
+ *   type *name_getfirst(struct name *ht, key k, struct lfht_iter *it);
+ *   type *name_getnext(struct name *ht, key k, struct lfht_iter *it);
+ *   type *name_first(struct name *ht, struct lfht_iter *it);
+ *   type *name_next(struct name *ht, struct lfht_iter *it);
+ *
+ * where @keyof is `key keyof(const type *p)', @hashfn is `size_t hashfn(key
+ * k)', and @eqfn is `bool eqfn(const type *p, key k)'. this is a type-safety
+ * wrapper and nothing more: the probe loop is lfht_firstval() and
+ * lfht_nextval() out of line as usual, and only @eqfn is called directly
+ * where lfht_get() would go through a function pointer. what's gained is that
+ * items go in and come out as @type, and lookups take the key itself, not a
+ * void * or an item made up to carry it.
+ *
+ * the raw lfht is ->raw, for use with the rest of the API. epoch rules are
+ * the same as for the functions wrapped.
+ */
+#define LFHT_DEFINE_TYPE(name, type, keyof, hashfn, eqfn) \
+	struct name { struct lfht raw; }; \
+	static inline size_t name##_rehash_(const void *ptr, void *priv) { \
+		return hashfn(keyof((const type *)ptr)); \
+	} \
+	static inline void name##_init(struct name *ht) { \
+		lfht_init(&ht->raw, &name##_rehash_, NULL); \
+	} \
+	static inline void name##_init_sized(struct name *ht, size_t size) { \
+		lfht_init_sized(&ht->raw, &name##_rehash_, NULL, size); \
+	} \
+	static inline void name##_init_ext( \
+		struct name *ht, size_t size, unsigned int flags) \
+	{ \
+		lfht_init_ext(&ht->raw, &name##_rehash_, NULL, size, flags); \
+	} \
+	static inline void name##_clear(struct name *ht) { \
+		lfht_clear(&ht->raw); \
+	} \
+	static inline bool name##_add(struct name *ht, type *p) { \
+		return lfht_add(&ht->raw, hashfn(keyof(p)), p); \
+	} \
+	static inline bool name##_del(struct name *ht, const type *p) { \
+		return lfht_del(&ht->raw, hashfn(keyof(p)), p); \
+	} \
+	static inline type *name##_getmatch_( \
+		struct name *ht, __typeof__(keyof((const type *)NULL)) k, \
+		size_t hash, type *cand, struct lfht_iter *it) \
+	{ \
+		for(; cand != NULL; cand = lfht_nextval(&ht->raw, it, hash)) { \
+			if(eqfn(cand, k)) return cand; \
+		} \
+		return NULL; \
+	} \
+	static inline type *name##_getfirst( \
+		struct name *ht, __typeof__(keyof((const type *)NULL)) k, \
+		struct lfht_iter *it) \
+	{ \
+		size_t hash = hashfn(k); \
+		return name##_getmatch_(ht, k, hash, \
+			lfht_firstval(&ht->raw, it, hash), it); \
+	} \
+	static inline type *name##_getnext( \
+		struct name *ht, __typeof__(keyof((const type *)NULL)) k, \
+		struct lfht_iter *it) \
+	{ \
+		return name##_getmatch_(ht, k, it->hash, \
+			lfht_nextval(&ht->raw, it, it->hash), it); \
+	} \
+	static inline type *name##_get( \
+		struct name *ht, __typeof__(keyof((const type *)NULL)) k) \
+	{ \
+		struct lfht_iter it; \
+		return name##_getfirst(ht, k, &it); \
+	} \
+	static inline bool name##_delkey( \
+		struct name *ht, __typeof__(keyof((const type *)NULL)) k) \
+	{ \
+		struct lfht_iter it; \
+		for(type *p = name##_getfirst(ht, k, &it); p != NULL; \
+			p = name##_getnext(ht, k, &it)) \
+		{ \
+			if(lfht_delval(&ht->raw, &it, p)) return true; \
+		} \
+		return false; \
+	} \
+	static inline type *name##_first(struct name *ht, struct lfht_iter *it) { \
+		return lfht_first(&ht->raw, it); \
+	} \
+	static inline type *name##_next(struct name *ht, struct lfht_iter *it) { \
+		return lfht_next(&ht->raw, it); \
+	}
+
+#endif
@@ -0,0 +1,80 @@
+
+/* tests on E_RECLAIM_ASYNC: that dtors are called by the reclaimer thread
+ * rather than the one that ends the bracket, that they're all called
+ * eventually, and that switching back to inline mode picks up where the
+ * reclaimer left off.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <ccan/tap/tap.h>
+
+#include "epoch.h"
+
+
+#define N_CALLS 5000
+
+
+static pthread_t main_thread;
+static _Atomic int dtor_calls = 0, dtor_on_main = 0;
+
+
+static void dtor_count(void *ptr)
+{
+	atomic_fetch_add(&dtor_calls, 1);
+	if(pthread_equal(pthread_self(), main_thread)) {
+		atomic_fetch_add(&dtor_on_main, 1);
+	}
+	free(ptr);
+}
+
+
+/* open and close brackets until @n dtors have been called, or a second or
+ * so has passed. the epoch only advances while there are dtors pending, so
+ * each bracket adds one of its own.
+ */
+static bool wait_for_calls(int n)
+{
+	for(int i = 0; i < 1000 && atomic_load(&dtor_calls) < n; i++) {
+		int eck = e_begin();
+		e_free(malloc(1));
+		e_end(eck);
+		usleep(1000);
+	}
+	return atomic_load(&dtor_calls) >= n;
+}
+
+
+int main(void)
+{
+	plan_tests(7);
+	main_thread = pthread_self();
+
+	ok1(e_set_reclaim_mode(-1) == -EINVAL);
+	ok1(e_set_reclaim_mode(E_RECLAIM_ASYNC) == 0);
+	ok1(e_get_reclaim_mode() == E_RECLAIM_ASYNC);
+
+	for(int i = 0; i < N_CALLS; i++) {
+		int eck = e_begin();
+		e_call_dtor(&dtor_count, malloc(16));
+		e_end(eck);
+	}
+	ok(wait_for_calls(N_CALLS), "all dtors called in async mode");
+	ok(dtor_on_main == 0, "no dtors called on main thread");
+
+	/* a second batch, mostly pending across the switch back to inline. */
+	for(int i = 0; i < N_CALLS; i++) {
+		int eck = e_begin();
+		e_call_dtor(&dtor_count, malloc(16));
+		e_end(eck);
+	}
+	ok1(e_set_reclaim_mode(E_RECLAIM_INLINE) == 0);
+	ok(wait_for_calls(N_CALLS * 2), "all dtors called after switch back");
+
+	return exit_status();
+}
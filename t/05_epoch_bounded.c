@@ -0,0 +1,85 @@
+
+/* tests on E_RECLAIM_BOUNDED: that no e_end() calls more dtors than the
+ * budget allows, that they all get called eventually, and that switching
+ * back to inline mode calls the rest.
+ */
+
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+
+#include "epoch.h"
+
+
+#define N_CALLS 3000
+#define BUDGET 10
+
+
+static _Atomic int dtor_calls = 0;
+
+
+static void dtor_count(void *ptr)
+{
+	atomic_fetch_add(&dtor_calls, 1);
+	free(ptr);
+}
+
+
+/* returns the largest number of dtors called by a single e_end() over
+ * @n_brackets brackets, each of which adds one dtor of its own.
+ */
+static int run_brackets(int n_brackets)
+{
+	int max = 0;
+	for(int i = 0; i < n_brackets; i++) {
+		int eck = e_begin();
+		e_call_dtor(&dtor_count, malloc(16));
+		int before = atomic_load(&dtor_calls);
+		e_end(eck);
+		int n = atomic_load(&dtor_calls) - before;
+		if(n > max) max = n;
+	}
+	return max;
+}
+
+
+int main(void)
+{
+	plan_tests(6);
+
+	ok1(e_set_reclaim_mode(E_RECLAIM_BOUNDED) == 0);
+	e_set_reclaim_budget(BUDGET);
+
+	/* a big lump at once, which inline mode would call in a single tick. */
+	int eck = e_begin();
+	for(int i = 0; i < N_CALLS; i++) e_call_dtor(&dtor_count, malloc(16));
+	e_end(eck);
+
+	int max = run_brackets(100);
+	ok(max > 0 && max <= BUDGET, "at most %d dtors per e_end() (max=%d)",
+		BUDGET, max);
+	ok1(dtor_calls < N_CALLS);
+
+	max = run_brackets(N_CALLS / BUDGET * 2);
+	ok1(max <= BUDGET);
+	ok(dtor_calls >= N_CALLS, "big lump called eventually (calls=%d)",
+		dtor_calls);
+
+	/* dtors still pending are called by the switch back, or by the inline
+	 * ticks right after.
+	 */
+	eck = e_begin();
+	for(int i = 0; i < N_CALLS; i++) e_call_dtor(&dtor_count, malloc(16));
+	e_end(eck);
+	run_brackets(10);
+	int pushed = N_CALLS * 2 + 100 + N_CALLS / BUDGET * 2 + 10;
+	e_set_reclaim_mode(E_RECLAIM_INLINE);
+	run_brackets(10);
+	ok(dtor_calls >= pushed, "switch to inline calls the rest (%d/%d)",
+		dtor_calls, pushed);
+
+	return exit_status();
+}
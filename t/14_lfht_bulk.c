@@ -0,0 +1,136 @@
+
+/* tests on lfht_add_bulk(): into an empty table, into a populated table, and
+ * mixed with ordinary adds and deletes afterward.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_BULK 20000
+#define NUM_SINGLE 3000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool str_in(struct lfht *ht, const char *str) {
+	const char *s = lfht_get(ht, str_hash_fn(str, NULL),
+		&cmp_str_ptr, str);
+	assert(s == NULL || strcmp(s, str) == 0);
+	return s != NULL;
+}
+
+
+static char *gen_string(int seed)
+{
+	char buf[100];
+	snprintf(buf, sizeof(buf), "test-%05x", seed);
+	return strdup(buf);
+}
+
+
+static size_t count_items(struct lfht *ht)
+{
+	size_t n = 0;
+	struct lfht_iter it;
+	for(void *cur = lfht_first(ht, &it); cur != NULL; cur = lfht_next(ht, &it)) {
+		n++;
+	}
+	return n;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(!str_in(ht, strs[i])) {
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(void)
+{
+	plan_tests(8);
+
+	const int total = NUM_BULK * 2 + NUM_SINGLE;
+	char **strs = malloc(sizeof(char *) * total);
+	size_t *hashes = malloc(sizeof(size_t) * total);
+	if(strs == NULL || hashes == NULL) abort();
+	for(int i = 0; i < total; i++) {
+		strs[i] = gen_string(i);
+		hashes[i] = str_hash_fn(strs[i], NULL);
+	}
+
+	int eck = e_begin();
+	struct lfht ht = LFHT_INITIALIZER(ht, &str_hash_fn, NULL);
+	ok1(lfht_add_bulk(&ht, hashes, (void **)strs, 0));
+	ok1(count_items(&ht) == 0);
+
+	/* into an empty table. */
+	bool ok = lfht_add_bulk(&ht, hashes, (void **)strs, NUM_BULK);
+	ok(ok && all_in(&ht, strs, 0, NUM_BULK), "bulk add into empty table");
+	ok1(count_items(&ht) == NUM_BULK);
+
+	/* some single adds, then another bulk load on top. */
+	for(int i = NUM_BULK * 2; i < total; i++) {
+		ok = lfht_add(&ht, hashes[i], strs[i]);
+		assert(ok);
+	}
+	ok = lfht_add_bulk(&ht, &hashes[NUM_BULK], (void **)&strs[NUM_BULK],
+		NUM_BULK);
+	ok(ok && all_in(&ht, strs, 0, total), "bulk add into populated table");
+
+	/* items should remain visible while ordinary adds drive migration
+	 * forward.
+	 */
+	bool found = true;
+	for(int i = 0; i < NUM_SINGLE; i++) {
+		char *s = gen_string(total + i);
+		ok = lfht_add(&ht, str_hash_fn(s, NULL), s);
+		assert(ok);
+		if(found && (i % 97) == 0) found = all_in(&ht, strs, 0, total);
+		if((i % 239) == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	ok(found, "bulk-added items remain during migration");
+	ok1(count_items(&ht) == total + NUM_SINGLE);
+
+	bool del_ok = true;
+	for(int i = 0; i < total; i++) {
+		if(!lfht_del(&ht, hashes[i], strs[i])) {
+			diag("failed to delete `%s'", strs[i]);
+			del_ok = false;
+			break;
+		}
+	}
+	ok(del_ok && !str_in(&ht, strs[0]) && !str_in(&ht, strs[total - 1]),
+		"bulk-added items were deleted");
+
+	lfht_clear(&ht);
+	e_end(eck);
+
+	return exit_status();
+}
@@ -0,0 +1,120 @@
+
+/* tests on lfht_get_batch(): that it agrees with lfht_get() for present and
+ * absent keys, including while items are spread across several tables during
+ * migration, and for batches that aren't a multiple of LFHT_BATCH_CHUNK.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_STRINGS 12000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static char *gen_string(int seed)
+{
+	char buf[100];
+	snprintf(buf, sizeof(buf), "test-%05x", seed);
+	return strdup(buf);
+}
+
+
+/* look up @n keys from @strs starting at @first, half of which are present
+ * (even indexes), and compare results to lfht_get().
+ */
+static bool batch_agrees(
+	struct lfht *ht, char **strs, size_t *hashes, int first, int n)
+{
+	void *out[n];
+	size_t found = lfht_get_batch(ht, &hashes[first], &cmp_str_ptr,
+		(void **)&strs[first], out, n);
+	size_t expect = 0;
+	for(int i = 0; i < n; i++) {
+		void *ref = lfht_get(ht, hashes[first + i], &cmp_str_ptr,
+			strs[first + i]);
+		if(ref != NULL) expect++;
+		if((out[i] == NULL) != (ref == NULL)
+			|| (out[i] != NULL && strcmp(out[i], strs[first + i]) != 0))
+		{
+			diag("mismatch for `%s': out=%p, ref=%p",
+				strs[first + i], out[i], ref);
+			return false;
+		}
+	}
+	if(found != expect) {
+		diag("found=%zu, expect=%zu", found, expect);
+		return false;
+	}
+	return true;
+}
+
+
+int main(void)
+{
+	plan_tests(4);
+
+	char **strs = malloc(sizeof(char *) * NUM_STRINGS);
+	size_t *hashes = malloc(sizeof(size_t) * NUM_STRINGS);
+	if(strs == NULL || hashes == NULL) abort();
+	for(int i = 0; i < NUM_STRINGS; i++) {
+		strs[i] = gen_string(i);
+		hashes[i] = str_hash_fn(strs[i], NULL);
+	}
+
+	int eck = e_begin();
+	struct lfht ht = LFHT_INITIALIZER(ht, &str_hash_fn, NULL);
+	ok1(batch_agrees(&ht, strs, hashes, 0, 37));
+
+	/* add the even ones, checking batches along the way so that some are
+	 * done while migration is in progress.
+	 */
+	bool ok_mid = true;
+	for(int i = 0; i < NUM_STRINGS; i += 2) {
+		bool ok = lfht_add(&ht, hashes[i], strs[i]);
+		assert(ok);
+		if(ok_mid && (i % 202) == 0) {
+			int first = i > 500 ? i - 500 : 0;
+			ok_mid = batch_agrees(&ht, strs, hashes, first, i - first + 1);
+		}
+		if((i % 239) == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	ok(ok_mid, "batches agree during adds");
+	ok(batch_agrees(&ht, strs, hashes, 0, NUM_STRINGS), "full batch agrees");
+
+	/* duplicate keys, and a batch of one. */
+	size_t dup_hashes[3] = { hashes[2], hashes[2], hashes[3] };
+	char *dups[3] = { strs[2], strs[2], strs[3] };
+	void *out[3];
+	size_t found = lfht_get_batch(&ht, dup_hashes, &cmp_str_ptr,
+		(void **)dups, out, 3);
+	ok(found == 2 && out[0] == strs[2] && out[1] == strs[2] && out[2] == NULL
+		&& batch_agrees(&ht, strs, hashes, 10, 1),
+		"duplicate keys and single-item batches");
+
+	lfht_clear(&ht);
+	e_end(eck);
+
+	return exit_status();
+}
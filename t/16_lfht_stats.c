@@ -0,0 +1,100 @@
+
+/* tests on lfht_stats(): that it reports nothing for an empty lfht, that the
+ * slot counts agree with what's been added and deleted, and that secondary
+ * tables show up while migration is in progress.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 5000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static char *gen_string(int seed)
+{
+	char buf[100];
+	snprintf(buf, sizeof(buf), "stats-%05x", seed);
+	return strdup(buf);
+}
+
+
+int main(void)
+{
+	plan_tests(8);
+
+	char **strs = malloc(sizeof(char *) * NUM_ITEMS);
+	for(int i = 0; i < NUM_ITEMS; i++) strs[i] = gen_string(i);
+
+	int eck = e_begin();
+	struct lfht ht = LFHT_INITIALIZER(ht, &str_hash_fn, NULL);
+	struct lfht_stats st;
+	lfht_stats(&ht, &st);
+	ok1(st.n_tables == 0);
+
+	/* watch for secondary tables while adding. */
+	bool saw_mig = false;
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(!saw_mig && (i % 16) == 0) {
+			lfht_stats(&ht, &st);
+			saw_mig = st.n_tables > 1
+				&& st.tables[1].gen_id < st.tables[0].gen_id;
+		}
+	}
+	ok(saw_mig, "secondary table seen during migration");
+
+	/* all values are somewhere, and none are in two places. */
+	lfht_stats(&ht, &st);
+	size_t values = 0, elems = 0;
+	for(size_t i = 0; i < st.n_tables && i < LFHT_STATS_MAX_TABLES; i++) {
+		values += st.tables[i].values;
+		elems += st.tables[i].elems;
+		if(st.tables[i].max_probe >= 1ul << st.tables[i].size_log2) {
+			diag("table %zu: max_probe=%zu", i, st.tables[i].max_probe);
+			values = 0;
+		}
+	}
+	ok(values == NUM_ITEMS, "values=%zu", values);
+	ok(elems == NUM_ITEMS, "elems=%zu", elems);
+	ok1(st.tables[0].size_log2 >= LFHT_MIN_TABLE_SIZE);
+
+	for(int i = 0; i < NUM_ITEMS / 2; i++) {
+		bool ok = lfht_del(&ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+	}
+	lfht_stats(&ht, &st);
+	values = 0;
+	size_t dead = 0;
+	for(size_t i = 0; i < st.n_tables && i < LFHT_STATS_MAX_TABLES; i++) {
+		values += st.tables[i].values;
+		dead += st.tables[i].tombstones + st.tables[i].migrated;
+	}
+	ok(values == NUM_ITEMS - NUM_ITEMS / 2, "values=%zu after deletes",
+		values);
+	ok(dead > 0, "dead slots=%zu", dead);
+
+	lfht_clear(&ht);
+	lfht_stats(&ht, &st);
+	ok1(st.n_tables == 0);
+	e_end(eck);
+
+	for(int i = 0; i < NUM_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,113 @@
+
+/* tests on lfht_probe_hist(): that adds, hits and misses get counted, and
+ * that a degenerate hash shows up in the far buckets. adds include copies
+ * made by migration, and a lookup may miss in several tables. the Makefile
+ * links this one against lfht.c built with -DLFHT_PROBE_HIST; elsewhere the
+ * rest is skipped.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 2000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static size_t bad_hash_fn(const void *key, void *priv) {
+	return str_hash_fn(key, priv) & 0x7;
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static size_t kind_total(const struct lfht_probe_hist *h, int kind)
+{
+	size_t sum = 0;
+	for(int b = 0; b < LFHT_PROBE_HIST_BUCKETS; b++) sum += h->counts[kind][b];
+	return sum;
+}
+
+
+int main(void)
+{
+	plan_tests(5);
+
+	char **strs = malloc(sizeof(char *) * NUM_ITEMS);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "hist-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	int eck = e_begin();
+	struct lfht_probe_hist h;
+	struct lfht ht;
+	lfht_init_sized(&ht, &str_hash_fn, NULL, NUM_ITEMS * 2);
+	bool on = lfht_probe_hist(&ht, &h);
+	ok1(kind_total(&h, LFHT_PROBE_ADD) == 0);
+	if(!on) {
+		skip(4, "built without LFHT_PROBE_HIST");
+		e_end(eck);
+		return exit_status();
+	}
+
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+	}
+	lfht_probe_hist(&ht, &h);
+	ok(kind_total(&h, LFHT_PROBE_ADD) >= NUM_ITEMS, "adds=%zu",
+		kind_total(&h, LFHT_PROBE_ADD));
+
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		const char *s = lfht_get(&ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]);
+		assert(s == strs[i]);
+	}
+	lfht_probe_hist(&ht, &h);
+	ok(kind_total(&h, LFHT_PROBE_HIT) >= NUM_ITEMS, "hits=%zu",
+		kind_total(&h, LFHT_PROBE_HIT));
+
+	size_t misses = kind_total(&h, LFHT_PROBE_MISS);
+	const char *nope = "not-in-there";
+	lfht_get(&ht, str_hash_fn(nope, NULL), &cmp_str_ptr, nope);
+	lfht_probe_hist(&ht, &h);
+	ok1(kind_total(&h, LFHT_PROBE_MISS) > misses);
+	lfht_clear(&ht);
+
+	/* eight home slots for everything means long probes. */
+	lfht_init_sized(&ht, &bad_hash_fn, NULL, 1024);
+	for(int i = 0; i < 200; i++) {
+		bool ok = lfht_add(&ht, bad_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+	}
+	lfht_probe_hist(&ht, &h);
+	size_t far = 0;
+	for(int b = 6; b < LFHT_PROBE_HIST_BUCKETS; b++) {
+		far += h.counts[LFHT_PROBE_ADD][b];
+	}
+	ok(far > 0, "far adds=%zu", far);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < NUM_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,149 @@
+
+/* tests on table shrinking: that adds after a mass deletion bring the main
+ * table back down in size once migration has caught up, that nothing goes
+ * missing on the way, and that lfht_init_sized()'s initial size is a floor.
+ * the mass deletion is followed by churn rather than relying on where the
+ * allocator put things, so it shrinks regardless of heap layout.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 20000
+#define NUM_KEEP 300
+#define NUM_MORE 2000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != strs[i])
+		{
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static size_t count_items(struct lfht *ht)
+{
+	size_t n = 0;
+	struct lfht_iter it;
+	for(void *cur = lfht_first(ht, &it); cur != NULL;
+		cur = lfht_next(ht, &it))
+	{
+		n++;
+	}
+	return n;
+}
+
+
+static int main_size_log2(struct lfht *ht)
+{
+	struct lfht_stats st;
+	lfht_stats(ht, &st);
+	return st.n_tables > 0 ? st.tables[0].size_log2 : -1;
+}
+
+
+/* add @n items from @strs[@first...] in brackets of a few each, so that
+ * migrated-out tables get reclaimed.
+ */
+static void add_items(struct lfht *ht, char **strs, int first, int n)
+{
+	int eck = e_begin();
+	for(int i = first; i < first + n; i++) {
+		bool ok = lfht_add(ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+}
+
+
+int main(void)
+{
+	plan_tests(6);
+
+	const int total = NUM_ITEMS + NUM_MORE;
+	char **strs = malloc(sizeof(char *) * total);
+	for(int i = 0; i < total; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "shrink-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	struct lfht ht = LFHT_INITIALIZER(ht, &str_hash_fn, NULL);
+	add_items(&ht, strs, 0, NUM_ITEMS);
+	int eck = e_begin();
+	int big = main_size_log2(&ht);
+	for(int i = NUM_KEEP; i < NUM_ITEMS; i++) {
+		bool ok = lfht_del(&ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+	}
+
+	/* the table only shrinks once it's the only one left, and growth
+	 * leaves migration unfinished; churn so that adds finish it without
+	 * raising the element count.
+	 */
+	for(int i = NUM_KEEP; i < NUM_ITEMS; i++) {
+		size_t hash = str_hash_fn(strs[i], NULL);
+		bool ok = lfht_add(&ht, hash, strs[i]);
+		ok = ok && lfht_del(&ht, hash, strs[i]);
+		assert(ok);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+
+	add_items(&ht, strs, NUM_ITEMS, NUM_MORE);
+	eck = e_begin();
+	int small = main_size_log2(&ht);
+	ok(small < big, "main table shrank (%d -> %d)", big, small);
+	ok1(all_in(&ht, strs, 0, NUM_KEEP));
+	ok1(all_in(&ht, strs, NUM_ITEMS, NUM_MORE));
+	ok1(count_items(&ht) == NUM_KEEP + NUM_MORE);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* the initial size is kept. */
+	lfht_init_sized(&ht, &str_hash_fn, NULL, 1 << 14);
+	add_items(&ht, strs, 0, NUM_KEEP);
+	eck = e_begin();
+	ok1(main_size_log2(&ht) == 14);
+	ok1(all_in(&ht, strs, 0, NUM_KEEP));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < total; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
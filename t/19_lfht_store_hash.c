@@ -0,0 +1,107 @@
+
+/* tests on LFHT_STORE_HASH: that migration doesn't call rehash_fn when the
+ * hashes are kept, that it does otherwise, and that all items survive either
+ * way.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 30000
+
+
+static _Atomic size_t rehash_calls = 0;
+
+
+static size_t str_hash(const char *key) {
+	return hashl(key, strlen(key), 0);
+}
+
+
+static size_t str_rehash_fn(const void *key, void *priv) {
+	atomic_fetch_add(&rehash_calls, 1);
+	return str_hash(key);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int n)
+{
+	for(int i = 0; i < n; i++) {
+		if(lfht_get(ht, str_hash(strs[i]), &cmp_str_ptr, strs[i]) != strs[i]) {
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+/* add @strs to @ht, which grows by a number of doublings. returns the number
+ * of rehash_fn calls made in the meantime.
+ */
+static size_t fill(struct lfht *ht, char **strs, int n)
+{
+	size_t before = rehash_calls;
+	int eck = e_begin();
+	for(int i = 0; i < n; i++) {
+		bool ok = lfht_add(ht, str_hash(strs[i]), strs[i]);
+		assert(ok);
+		if(i % 128 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+	return rehash_calls - before;
+}
+
+
+int main(void)
+{
+	plan_tests(5);
+
+	char **strs = malloc(sizeof(char *) * NUM_ITEMS);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "stored-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	struct lfht ht;
+	lfht_init(&ht, &str_rehash_fn, NULL);
+	size_t calls = fill(&ht, strs, NUM_ITEMS);
+	ok(calls > 0, "rehash_fn called %zu times without stored hashes", calls);
+	int eck = e_begin();
+	ok1(all_in(&ht, strs, NUM_ITEMS));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	lfht_init_ext(&ht, &str_rehash_fn, NULL, 0, LFHT_STORE_HASH);
+	ok1(ht.flags == LFHT_STORE_HASH);
+	calls = fill(&ht, strs, NUM_ITEMS);
+	ok(calls == 0, "rehash_fn called %zu times with stored hashes", calls);
+	eck = e_begin();
+	ok1(all_in(&ht, strs, NUM_ITEMS));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < NUM_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,113 @@
+
+/* tests on LFHT_CHECK_HASH: that lookups hand only candidates with the right
+ * hash to the comparison function, where the packed format alone lets false
+ * positives through.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <sys/mman.h>
+
+#include <ccan/tap/tap.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 2000
+
+
+struct item {
+	size_t hash;
+	int key;
+};
+
+
+static size_t cmp_calls = 0;
+
+
+static size_t item_rehash_fn(const void *ptr, void *priv) {
+	return ((const struct item *)ptr)->hash;
+}
+
+
+static bool cmp_item(const void *cand, void *ref) {
+	cmp_calls++;
+	return ((const struct item *)cand)->key == ((struct item *)ref)->key;
+}
+
+
+/* look up each of @items, returning the number of comparisons done. */
+static size_t lookup_all(struct lfht *ht, struct item **items, bool *ok_p)
+{
+	size_t before = cmp_calls;
+	*ok_p = true;
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		if(lfht_get(ht, items[i]->hash, &cmp_item, items[i]) != items[i]) {
+			diag("didn't find item %d", i);
+			*ok_p = false;
+			break;
+		}
+	}
+	return cmp_calls - before;
+}
+
+
+static void add_all(struct lfht *ht, struct item **items)
+{
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(ht, items[i]->hash, items[i]);
+		assert(ok);
+	}
+}
+
+
+int main(void)
+{
+	plan_tests(5);
+
+	/* items are put on the heap and in a separate mapping, whose addresses
+	 * differ in most bits; so few bits are common to all pointers, and few
+	 * hash bits fit in the slots. the hashes are distinct, but share their
+	 * low bits so that they pile up in a few probe chains.
+	 */
+	struct item *heap = calloc(NUM_ITEMS / 2, sizeof(struct item)),
+		*map = mmap(NULL, NUM_ITEMS / 2 * sizeof(struct item),
+			PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0),
+		*items[NUM_ITEMS];
+	assert(heap != NULL && map != MAP_FAILED);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		items[i] = i % 2 == 0 ? &heap[i / 2] : &map[i / 2];
+		*items[i] = (struct item){ .key = i,
+			.hash = ((size_t)(i + 1) << 20) | (i & 3) };
+	}
+
+	int eck = e_begin();
+	bool ok;
+	struct lfht ht;
+	lfht_init(&ht, &item_rehash_fn, NULL);
+	add_all(&ht, items);
+	size_t plain = lookup_all(&ht, items, &ok);
+	ok(ok, "all found in packed format");
+	ok(plain > NUM_ITEMS, "packed format compared %zu times", plain);
+	lfht_clear(&ht);
+
+	lfht_init_ext(&ht, &item_rehash_fn, NULL, 0, LFHT_CHECK_HASH);
+	add_all(&ht, items);
+	size_t checked = lookup_all(&ht, items, &ok);
+	ok(ok, "all found with LFHT_CHECK_HASH");
+	ok(checked == NUM_ITEMS, "LFHT_CHECK_HASH compared %zu times", checked);
+	struct item none = { .key = -1, .hash = (size_t)1234 << 32 };
+	size_t before = cmp_calls;
+	ok1(lfht_get(&ht, none.hash, &cmp_item, &none) == NULL
+		&& cmp_calls == before);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	munmap(map, NUM_ITEMS / 2 * sizeof(struct item));
+	free(heap);
+
+	return exit_status();
+}
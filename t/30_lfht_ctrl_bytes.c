@@ -0,0 +1,148 @@
+
+/* tests on LFHT_CTRL_BYTES: that lookups find everything that was added and
+ * nothing that wasn't, through growth and migration, through deletions and
+ * re-adds that send control bytes to the wildcard value, and with hashes
+ * that share the tag bits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 20000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+/* every hash has the same top bits, so every tag is the same. */
+static size_t low_hash_fn(const void *key, void *priv) {
+	return str_hash_fn(key, priv) & 0xffffff;
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, ht->rehash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != strs[i])
+		{
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static bool none_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, ht->rehash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != NULL)
+		{
+			diag("found `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static void add_items(struct lfht *ht, char **strs, int first, int n)
+{
+	int eck = e_begin();
+	for(int i = first; i < first + n; i++) {
+		bool ok = lfht_add(ht, ht->rehash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+}
+
+
+int main(void)
+{
+	plan_tests(8);
+
+	char **strs = malloc(sizeof(char *) * NUM_ITEMS * 2);
+	for(int i = 0; i < NUM_ITEMS * 2; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "ctrl-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	/* from the smallest table upward, so there's migration throughout. */
+	struct lfht ht;
+	lfht_init_ext(&ht, &str_hash_fn, NULL, 0, LFHT_CTRL_BYTES);
+	add_items(&ht, strs, 0, NUM_ITEMS);
+	int eck = e_begin();
+	ok1(all_in(&ht, strs, 0, NUM_ITEMS));
+	ok1(none_in(&ht, strs, NUM_ITEMS, NUM_ITEMS));
+
+	/* delete half and put different items in their place. */
+	for(int i = 0; i < NUM_ITEMS; i += 2) {
+		bool ok = lfht_del(&ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+	add_items(&ht, strs, NUM_ITEMS, NUM_ITEMS / 2);
+	eck = e_begin();
+	bool odd_in = true, even_out = true;
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		if(i % 2 != 0) odd_in = odd_in && all_in(&ht, strs, i, 1);
+		else even_out = even_out && none_in(&ht, strs, i, 1);
+	}
+	ok1(odd_in);
+	ok1(even_out);
+	ok1(all_in(&ht, strs, NUM_ITEMS, NUM_ITEMS / 2));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* one tag for everything; the control bytes filter nothing, but
+	 * lookups must still stop at the never-written ones.
+	 */
+	lfht_init_ext(&ht, &low_hash_fn, NULL, 0, LFHT_CTRL_BYTES);
+	add_items(&ht, strs, 0, NUM_ITEMS / 4);
+	eck = e_begin();
+	ok1(all_in(&ht, strs, 0, NUM_ITEMS / 4));
+	ok1(none_in(&ht, strs, NUM_ITEMS, NUM_ITEMS / 4));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* and together with the stored hashes. */
+	lfht_init_ext(&ht, &str_hash_fn, NULL, 0,
+		LFHT_CTRL_BYTES | LFHT_CHECK_HASH);
+	add_items(&ht, strs, 0, NUM_ITEMS);
+	eck = e_begin();
+	ok1(all_in(&ht, strs, 0, NUM_ITEMS) && none_in(&ht, strs, NUM_ITEMS, 100));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < NUM_ITEMS * 2; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,120 @@
+
+/* tests on LFHT_READ_MIGRATE: that lookups alone finish a migration left
+ * unfinished by the adds that started it, and don't lose anything on the way;
+ * and that without the flag, they don't.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define MAX_ITEMS 50000
+#define MAX_ROUNDS 8
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static size_t n_tables(struct lfht *ht)
+{
+	struct lfht_stats st;
+	lfht_stats(ht, &st);
+	return st.n_tables;
+}
+
+
+/* add from @strs until there's a secondary table, and a few more after.
+ * returns the number added.
+ */
+static int add_until_migrating(struct lfht *ht, char **strs)
+{
+	int eck = e_begin(), i;
+	for(i = 0; i < MAX_ITEMS; i++) {
+		bool ok = lfht_add(ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i > 1000 && i % 16 == 0 && n_tables(ht) > 1) break;
+	}
+	e_end(eck);
+	return i + 1;
+}
+
+
+/* look each of @strs[0..@n) up, once per round, until there's just the one
+ * table left. returns the number of rounds that took, or MAX_ROUNDS + 1.
+ */
+static int lookup_rounds(struct lfht *ht, char **strs, int n, bool *ok_p)
+{
+	*ok_p = true;
+	int round;
+	for(round = 1; round <= MAX_ROUNDS; round++) {
+		int eck = e_begin();
+		for(int i = 0; i < n; i++) {
+			if(lfht_get(ht, str_hash_fn(strs[i], NULL),
+				&cmp_str_ptr, strs[i]) != strs[i])
+			{
+				diag("didn't find `%s' (i=%d)", strs[i], i);
+				*ok_p = false;
+			}
+		}
+		bool done = n_tables(ht) == 1;
+		e_end(eck);
+		if(done) break;
+	}
+	return round;
+}
+
+
+int main(void)
+{
+	plan_tests(6);
+
+	char **strs = malloc(sizeof(char *) * MAX_ITEMS);
+	for(int i = 0; i < MAX_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "readmig-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	struct lfht ht;
+	lfht_init_ext(&ht, &str_hash_fn, NULL, 0, LFHT_READ_MIGRATE);
+	int n = add_until_migrating(&ht, strs);
+	ok(n < MAX_ITEMS, "migrating after %d adds", n);
+	bool all_ok;
+	int rounds = lookup_rounds(&ht, strs, n, &all_ok);
+	ok(rounds <= MAX_ROUNDS, "single table after %d rounds", rounds);
+	ok1(all_ok);
+	int eck = e_begin();
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* the same without the flag. */
+	lfht_init(&ht, &str_hash_fn, NULL);
+	n = add_until_migrating(&ht, strs);
+	ok1(n < MAX_ITEMS);
+	rounds = lookup_rounds(&ht, strs, n, &all_ok);
+	ok(rounds > MAX_ROUNDS, "still migrating after %d rounds", MAX_ROUNDS);
+	ok1(all_ok);
+	eck = e_begin();
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < MAX_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,135 @@
+
+/* tests on the per-block migration summaries: that a secondary table's
+ * blocks get marked as migration passes over them, including those it passed
+ * over in pieces, and that lookups stepping over marked blocks still find
+ * everything and nothing else while migration is in progress.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define MAX_ITEMS 100000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool none_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != NULL)
+		{
+			diag("found `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != strs[i])
+		{
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+int main(void)
+{
+	plan_tests(7);
+
+	char **strs = malloc(sizeof(char *) * MAX_ITEMS);
+	for(int i = 0; i < MAX_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "migskip-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	/* grow until there's a secondary table of a few thousand slots. */
+	struct lfht ht;
+	lfht_init(&ht, &str_hash_fn, NULL);
+	struct lfht_stats st;
+	int eck = e_begin(), n;
+	for(n = 0; n < MAX_ITEMS; n++) {
+		bool ok = lfht_add(&ht, str_hash_fn(strs[n], NULL), strs[n]);
+		assert(ok);
+		if(n > 20000 && n % 16 == 0) {
+			lfht_stats(&ht, &st);
+			if(st.n_tables > 1) break;
+		}
+	}
+	n++;
+	e_end(eck);
+	ok(st.n_tables > 1, "migrating after %d adds", n);
+	ok1(st.tables[0].done_blocks == 0);
+
+	/* each add migrates one entry; check after every so many. migration
+	 * goes down each per-CPU chunk from the top, so no more than a few
+	 * blocks per chunk should be left unmarked behind it.
+	 */
+	long n_cpus = sysconf(_SC_NPROCESSORS_CONF);
+	bool all_ok = true, saw_done = false, marked = true, misses = true;
+	for(int i = n; i < MAX_ITEMS && all_ok; i++) {
+		eck = e_begin();
+		bool ok = lfht_add(&ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i % 512 == 0) {
+			lfht_stats(&ht, &st);
+			if(st.n_tables < 2) {
+				e_end(eck);
+				break;
+			}
+			saw_done = saw_done || st.tables[1].done_blocks > 0;
+			size_t moved = (1ul << st.tables[1].size_log2)
+				- st.tables[1].mig_left;
+			if(st.tables[1].done_blocks + 3 * n_cpus < moved / 64) {
+				diag("done_blocks=%zu, moved=%zu",
+					st.tables[1].done_blocks, moved);
+				marked = false;
+			}
+			all_ok = all_in(&ht, strs, 0, i + 1);
+			misses = misses && none_in(&ht, strs, i + 1,
+				MAX_ITEMS - i - 1 < 256 ? MAX_ITEMS - i - 1 : 256);
+		}
+		e_end(eck);
+	}
+	ok1(all_ok);
+	ok(saw_done, "blocks marked during migration");
+	ok1(marked);
+	ok1(misses);
+
+	eck = e_begin();
+	ok1(all_in(&ht, strs, 0, n));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < MAX_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,148 @@
+
+/* tests on lfht_migrate_assist() and the migrator thread: that a bounded
+ * call does a bounded amount of work, that an unbounded one finishes
+ * migration, and that the migrator finishes it in the background, also
+ * after it's gone idle in between.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define MAX_ITEMS 50000
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != strs[i])
+		{
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static size_t n_tables(struct lfht *ht, size_t *mig_left_p)
+{
+	struct lfht_stats st;
+	int eck = e_begin();
+	lfht_stats(ht, &st);
+	e_end(eck);
+	if(mig_left_p != NULL) {
+		*mig_left_p = 0;
+		for(size_t i = 1; i < st.n_tables && i < LFHT_STATS_MAX_TABLES; i++) {
+			*mig_left_p += st.tables[i].mig_left;
+		}
+	}
+	return st.n_tables;
+}
+
+
+/* waits up to a second for @ht to be down to one table. returns the number
+ * of tables there were at the last look.
+ */
+static size_t wait_single(struct lfht *ht)
+{
+	size_t tabs = n_tables(ht, NULL);
+	for(int i = 0; i < 2000 && tabs > 1; i++) {
+		usleep(500);
+		tabs = n_tables(ht, NULL);
+	}
+	return tabs;
+}
+
+
+/* add from @strs[@first...] until there's a secondary table, and a few more
+ * after. returns the index past the last one added.
+ */
+static int add_until_migrating(struct lfht *ht, char **strs, int first)
+{
+	int eck = e_begin(), i;
+	for(i = first; i < MAX_ITEMS; i++) {
+		bool ok = lfht_add(ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i > first + 1000 && i % 16 == 0 && n_tables(ht, NULL) > 1) break;
+	}
+	e_end(eck);
+	return i + 1;
+}
+
+
+int main(void)
+{
+	plan_tests(9);
+
+	char **strs = malloc(sizeof(char *) * MAX_ITEMS);
+	for(int i = 0; i < MAX_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "assist-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	struct lfht ht;
+	lfht_init(&ht, &str_hash_fn, NULL);
+	int n = add_until_migrating(&ht, strs, 0);
+	size_t left_before, left_after;
+	ok1(n_tables(&ht, &left_before) > 1);
+
+	int eck = e_begin();
+	bool more = lfht_migrate_assist(&ht, 10);
+	e_end(eck);
+	n_tables(&ht, &left_after);
+	ok(more && left_after < left_before
+			&& left_after + 10 * LFHT_MIG_CLAIM >= left_before,
+		"bounded step (%zu -> %zu)", left_before, left_after);
+
+	eck = e_begin();
+	more = lfht_migrate_assist(&ht, (size_t)-1);
+	e_end(eck);
+	ok1(!more);
+	ok1(n_tables(&ht, NULL) == 1);
+	eck = e_begin();
+	ok1(all_in(&ht, strs, 0, n));
+	e_end(eck);
+
+	/* the background thread does the same. */
+	struct lfht_migrator *m = lfht_migrator_start(&ht);
+	ok1(m != NULL);
+	int n2 = add_until_migrating(&ht, strs, n);
+	size_t tabs = wait_single(&ht);
+	ok(tabs == 1, "migrator finished (%zu tables)", tabs);
+	usleep(10000);
+	n2 = add_until_migrating(&ht, strs, n2);
+	tabs = wait_single(&ht);
+	ok(tabs == 1, "woke up for the next one (%zu tables)", tabs);
+	lfht_migrator_stop(m);
+	eck = e_begin();
+	ok1(all_in(&ht, strs, 0, n2));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < MAX_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
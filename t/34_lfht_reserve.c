@@ -0,0 +1,169 @@
+
+/* tests on lfht_reserve(): that it sizes the first table of an empty lfht,
+ * that it grows a live one in a single step, that adding up to the reserved
+ * count causes no further growth, that a smaller reservation is a no-op, and
+ * that the reservation doesn't stop the table from shrinking once it's grown
+ * past it. (gen_id may still advance by remasking.)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_FIRST 1000
+#define NUM_ITEMS 100000
+#define NUM_KEEP 300
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static bool all_in(struct lfht *ht, char **strs, int first, int n)
+{
+	for(int i = first; i < first + n; i++) {
+		if(lfht_get(ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]) != strs[i])
+		{
+			diag("didn't find `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static struct lfht_table_stats main_stats(struct lfht *ht)
+{
+	struct lfht_stats st;
+	int eck = e_begin();
+	lfht_stats(ht, &st);
+	e_end(eck);
+	return st.tables[0];
+}
+
+
+/* deletes the items of @strs[@first...] and adds and deletes them again
+ * until the main table is smaller than 1 << @below_log2, or a number of
+ * rounds have gone by. returns the main table's size_log2 at the end.
+ */
+static int shrink(struct lfht *ht, char **strs, int first, int n,
+	int below_log2)
+{
+	int eck = e_begin();
+	for(int i = first; i < first + n; i++) {
+		bool ok = lfht_del(ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+	}
+	e_end(eck);
+	for(int round = 0; round < 10; round++) {
+		if(main_stats(ht).size_log2 < below_log2) break;
+		eck = e_begin();
+		for(int i = first; i < first + n; i++) {
+			size_t hash = str_hash_fn(strs[i], NULL);
+			bool ok = lfht_add(ht, hash, strs[i]);
+			ok = ok && lfht_del(ht, hash, strs[i]);
+			assert(ok);
+			if(i % 64 == 0) {
+				e_end(eck);
+				eck = e_begin();
+			}
+		}
+		e_end(eck);
+	}
+	return main_stats(ht).size_log2;
+}
+
+
+/* returns the smallest main table size seen along the way. */
+static int add_items(struct lfht *ht, char **strs, int first, int n)
+{
+	int eck = e_begin(), min_log2 = 64;
+	for(int i = first; i < first + n; i++) {
+		bool ok = lfht_add(ht, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i % 64 == 0) {
+			e_end(eck);
+			if(i % 1024 == 0 && main_stats(ht).size_log2 < min_log2) {
+				min_log2 = main_stats(ht).size_log2;
+			}
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+	return min_log2;
+}
+
+
+int main(void)
+{
+	plan_tests(10);
+
+	char **strs = malloc(sizeof(char *) * NUM_ITEMS);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "reserve-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	/* before the first add. 3/4 of 8k is the first to fit 5000. */
+	struct lfht ht;
+	lfht_init(&ht, &str_hash_fn, NULL);
+	ok1(lfht_reserve(&ht, 5000));
+	int min_log2 = add_items(&ht, strs, 0, 5000);
+	struct lfht_table_stats st = main_stats(&ht);
+	ok(st.size_log2 == 13 && min_log2 == 13, "size_log2=%d..%d",
+		min_log2, (int)st.size_log2);
+
+	/* past the next doubling, it shrinks as usual. */
+	add_items(&ht, strs, 5000, NUM_ITEMS - 5000);
+	int small = shrink(&ht, strs, NUM_KEEP, NUM_ITEMS - NUM_KEEP, 13);
+	ok(small < 13, "shrank to size_log2=%d", small);
+	ok1(ht.first_size_log2 == LFHT_MIN_TABLE_SIZE);
+	int eck = e_begin();
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* on a live table. */
+	lfht_init(&ht, &str_hash_fn, NULL);
+	add_items(&ht, strs, 0, NUM_FIRST);
+	struct lfht_table_stats before = main_stats(&ht);
+	ok1(lfht_reserve(&ht, NUM_ITEMS));
+	st = main_stats(&ht);
+	ok(st.size_log2 == 18 && st.gen_id == before.gen_id + 1,
+		"size_log2=%d gen_id=%lu", (int)st.size_log2, st.gen_id);
+
+	min_log2 = add_items(&ht, strs, NUM_FIRST, NUM_ITEMS - NUM_FIRST);
+	struct lfht_table_stats after = main_stats(&ht);
+	ok(min_log2 == 18 && after.size_log2 == 18,
+		"no resizes while filling (size_log2=%d..%d)", min_log2,
+		(int)after.size_log2);
+	eck = e_begin();
+	ok1(all_in(&ht, strs, 0, NUM_ITEMS));
+	e_end(eck);
+
+	ok1(lfht_reserve(&ht, 10));
+	ok1(main_stats(&ht).size_log2 == 18);
+	eck = e_begin();
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int i = 0; i < NUM_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,219 @@
+
+/* tests on lfht_copy() and lfht_copy_mt(): that the clone has exactly the
+ * items of the source, including those still in secondary tables, in one
+ * table; that it's independent of the source; that the flags carry over; and
+ * that a copy of a table that's being added to, deleted from and migrated
+ * meanwhile has each of the items that were there throughout exactly once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 30000
+#define NUM_CHURN 20000
+#define NUM_COPIES 10
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+static size_t count_items(struct lfht *ht)
+{
+	size_t n = 0;
+	struct lfht_iter it;
+	for(void *cur = lfht_first(ht, &it); cur != NULL; cur = lfht_next(ht, &it)) {
+		n++;
+	}
+	return n;
+}
+
+
+/* odd ones were deleted from the source. */
+static bool check_clone(struct lfht *ht, char **strs, int n)
+{
+	for(int i = 0; i < n; i++) {
+		const char *s = lfht_get(ht, str_hash_fn(strs[i], NULL),
+			&cmp_str_ptr, strs[i]);
+		if(s != (i % 2 == 0 ? strs[i] : NULL)) {
+			diag("wrong result for `%s' (i=%d)", strs[i], i);
+			return false;
+		}
+	}
+	return count_items(ht) == (n + 1) / 2;
+}
+
+
+/* how many times @s is in @ht. */
+static int n_copies(struct lfht *ht, const char *s)
+{
+	size_t hash = str_hash_fn(s, NULL);
+	struct lfht_iter it;
+	int n = 0;
+	for(void *c = lfht_firstval(ht, &it, hash); c != NULL;
+		c = lfht_nextval(ht, &it, hash))
+	{
+		if(c == s) n++;
+	}
+	return n;
+}
+
+
+static struct lfht *shared;
+static char **churn;
+static _Atomic bool done = false;
+
+
+/* adds and deletes items over and over, so that the table grows and shrinks
+ * and migrates underneath the copies.
+ */
+static void *churn_fn(void *param)
+{
+	while(!atomic_load(&done)) {
+		int eck = e_begin();
+		for(int i = 0; i < NUM_CHURN; i++) {
+			bool ok = lfht_add(shared, str_hash_fn(churn[i], NULL), churn[i]);
+			assert(ok);
+			if(i % 64 == 0) {
+				e_end(eck);
+				eck = e_begin();
+			}
+		}
+		for(int i = 0; i < NUM_CHURN; i++) {
+			bool ok = lfht_del(shared, str_hash_fn(churn[i], NULL), churn[i]);
+			assert(ok);
+			if(i % 64 == 0) {
+				e_end(eck);
+				eck = e_begin();
+			}
+		}
+		e_end(eck);
+	}
+	return NULL;
+}
+
+
+static size_t n_tables(struct lfht *ht)
+{
+	struct lfht_stats st;
+	lfht_stats(ht, &st);
+	return st.n_tables;
+}
+
+
+int main(void)
+{
+	plan_tests(12);
+
+	char **strs = malloc(sizeof(char *) * NUM_ITEMS);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "copy-%05x", i);
+		strs[i] = strdup(buf);
+	}
+
+	struct lfht src, dst;
+	lfht_init_ext(&src, &str_hash_fn, NULL, 0, LFHT_STORE_HASH);
+	int eck = e_begin();
+	lfht_copy(&dst, &src);
+	ok1(n_tables(&dst) == 0 && count_items(&dst) == 0);
+	lfht_clear(&dst);
+
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&src, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+		if(i % 2 != 0) {
+			ok = lfht_del(&src, str_hash_fn(strs[i], NULL), strs[i]);
+			assert(ok);
+		}
+	}
+	diag("source has %zu tables", n_tables(&src));
+
+	ok1(lfht_copy(&dst, &src));
+	ok1(n_tables(&dst) == 1);
+	ok1(dst.flags == LFHT_STORE_HASH && dst.rehash_fn == src.rehash_fn);
+	ok1(check_clone(&dst, strs, NUM_ITEMS));
+
+	/* changes to one don't show up in the other. */
+	bool ok = lfht_del(&dst, str_hash_fn(strs[0], NULL), strs[0]);
+	ok1(ok && lfht_get(&src, str_hash_fn(strs[0], NULL),
+		&cmp_str_ptr, strs[0]) == strs[0]);
+	ok1(check_clone(&src, strs, NUM_ITEMS));
+	lfht_clear(&dst);
+
+	ok1(lfht_copy_mt(&dst, &src, 4));
+	ok1(n_tables(&dst) == 1);
+	ok1(check_clone(&dst, strs, NUM_ITEMS));
+	lfht_clear(&dst);
+
+	/* more threads than slots. */
+	lfht_clear(&src);
+	lfht_add(&src, str_hash_fn(strs[0], NULL), strs[0]);
+	lfht_copy_mt(&dst, &src, 100);
+	ok1(check_clone(&dst, strs, 1));
+	lfht_clear(&dst);
+	lfht_clear(&src);
+	e_end(eck);
+
+	/* copies of a live table. */
+	churn = malloc(sizeof(char *) * NUM_CHURN);
+	for(int i = 0; i < NUM_CHURN; i++) {
+		char buf[100];
+		snprintf(buf, sizeof(buf), "churn-%05x", i);
+		churn[i] = strdup(buf);
+	}
+	lfht_init_ext(&src, &str_hash_fn, NULL, 0, LFHT_READ_MIGRATE);
+	eck = e_begin();
+	for(int i = 0; i < NUM_ITEMS; i += 8) {
+		bool ok = lfht_add(&src, str_hash_fn(strs[i], NULL), strs[i]);
+		assert(ok);
+	}
+	e_end(eck);
+	shared = &src;
+	pthread_t ct;
+	if(pthread_create(&ct, NULL, &churn_fn, NULL) != 0) abort();
+	bool once = true;
+	for(int c = 0; c < NUM_COPIES && once; c++) {
+		eck = e_begin();
+		once = lfht_copy_mt(&dst, &src, 1 + c % 3);
+		for(int i = 0; i < NUM_ITEMS && once; i += 8) {
+			int n = n_copies(&dst, strs[i]);
+			if(n != 1) {
+				diag("copy %d has `%s' %d times", c, strs[i], n);
+				once = false;
+			}
+		}
+		lfht_clear(&dst);
+		e_end(eck);
+	}
+	atomic_store(&done, true);
+	pthread_join(ct, NULL);
+	ok(once, "live copies have the stable items once each");
+	eck = e_begin();
+	lfht_clear(&src);
+	e_end(eck);
+
+	for(int i = 0; i < NUM_CHURN; i++) free(churn[i]);
+	free(churn);
+	for(int i = 0; i < NUM_ITEMS; i++) free(strs[i]);
+	free(strs);
+
+	return exit_status();
+}
@@ -0,0 +1,124 @@
+
+/* tests on lfht_rehash(): that a seed breaks up hashes that cluster in a
+ * table's low bits, that everything stays findable while items migrate to the
+ * seeded table and after, and that a seed set before the first add applies
+ * to the first table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 2000
+
+
+struct item {
+	size_t hash;
+	int key;
+};
+
+
+static size_t item_rehash_fn(const void *ptr, void *priv) {
+	return ((const struct item *)ptr)->hash;
+}
+
+
+static bool cmp_item(const void *cand, void *ref) {
+	return ((const struct item *)cand)->key == ((struct item *)ref)->key;
+}
+
+
+static bool all_in(struct lfht *ht, struct item *items, int n)
+{
+	for(int i = 0; i < n; i++) {
+		if(lfht_get(ht, items[i].hash, &cmp_item, &items[i]) != &items[i]) {
+			diag("didn't find item %d", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static size_t max_probe(struct lfht *ht)
+{
+	struct lfht_stats st;
+	lfht_stats(ht, &st);
+	size_t max = 0;
+	for(size_t i = 0; i < st.n_tables && i < LFHT_STATS_MAX_TABLES; i++) {
+		if(st.tables[i].max_probe > max) max = st.tables[i].max_probe;
+	}
+	return max;
+}
+
+
+static size_t n_tables(struct lfht *ht)
+{
+	struct lfht_stats st;
+	lfht_stats(ht, &st);
+	return st.n_tables;
+}
+
+
+int main(void)
+{
+	plan_tests(8);
+
+	struct item *items = calloc(NUM_ITEMS, sizeof *items);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		items[i].key = i;
+		/* four home slots in a table of up to 4k. */
+		items[i].hash = (size_t)i << 10;
+	}
+
+	int eck = e_begin();
+	struct lfht ht;
+	lfht_init_sized(&ht, &item_rehash_fn, NULL, 4096);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&ht, items[i].hash, &items[i]);
+		assert(ok);
+	}
+	size_t before = max_probe(&ht);
+	ok(before >= NUM_ITEMS / 8, "clustered (max_probe=%zu)", before);
+
+	ok1(lfht_rehash(&ht, 0x12345) && n_tables(&ht) > 1);
+	bool mid_ok = true;
+	for(int i = 0; i < 100; i++) {
+		lfht_migrate_assist(&ht, 8);
+		mid_ok = mid_ok && all_in(&ht, items, NUM_ITEMS);
+	}
+	ok(mid_ok, "all found during migration");
+	lfht_migrate_assist(&ht, (size_t)-1);
+	ok1(n_tables(&ht) == 1);
+	size_t after = max_probe(&ht);
+	ok(after < before / 4, "max_probe %zu -> %zu", before, after);
+	ok1(all_in(&ht, items, NUM_ITEMS));
+
+	/* deletion through the seeded table. */
+	bool ok = lfht_del(&ht, items[0].hash, &items[0]);
+	ok1(ok && lfht_get(&ht, items[0].hash, &cmp_item, &items[0]) == NULL);
+	lfht_clear(&ht);
+
+	/* seed before the first table. */
+	lfht_init_sized(&ht, &item_rehash_fn, NULL, 4096);
+	lfht_rehash(&ht, 0xabcdef);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&ht, items[i].hash, &items[i]);
+		assert(ok);
+	}
+	ok(max_probe(&ht) < before / 4 && all_in(&ht, items, NUM_ITEMS),
+		"seeded from the start (max_probe=%zu)", max_probe(&ht));
+	lfht_clear(&ht);
+	e_end(eck);
+
+	free(items);
+
+	return exit_status();
+}
@@ -0,0 +1,256 @@
+
+/* tests on the escape table: that items whose pointers have no bits in
+ * common, which'd leave no room for the reserved bits, can be added, found,
+ * iterated over, deleted, bulk-added and copied alongside ordinary ones; also
+ * bulk-added into a table that has ordinary ones already, and by several
+ * threads at once. and that lfht_copy() takes escaped items back into the
+ * table once the ones they clashed with are gone.
+ *
+ * the "pointers" are made up and never dereferenced; the hash function and
+ * comparison work on their values alone.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <ccan/tap/tap.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 5000
+#define NUM_THREADS 4
+#define PER_THREAD 500
+
+
+static size_t mix(uint64_t x)
+{
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdull;
+	x ^= x >> 33;
+	x *= 0xc4ceb9fe1a85ec53ull;
+	x ^= x >> 33;
+	return x;
+}
+
+
+static size_t ptr_hash_fn(const void *ptr, void *priv) {
+	return mix((uintptr_t)ptr);
+}
+
+
+static bool cmp_ptr(const void *cand, void *ref) {
+	return cand == ref;
+}
+
+
+/* the first half look like the heap, the rest are all over the place. */
+static void *fake_ptr(int i)
+{
+	if(i < NUM_ITEMS / 2) return (void *)(0x10000000ul + i * 16ul);
+	return (void *)(uintptr_t)(mix(i) | 2);
+}
+
+
+/* all set in bits 32..63, where fake_ptr()'s heap half is clear. */
+static void *high_ptr(int i) {
+	return (void *)(0xffffffffe0000000ul - i * 16ul);
+}
+
+
+static bool check(struct lfht *ht, int n, bool (*present)(int))
+{
+	for(int i = 0; i < n; i++) {
+		void *p = fake_ptr(i);
+		void *got = lfht_get(ht, ptr_hash_fn(p, NULL), &cmp_ptr, p);
+		if(got != (present(i) ? p : NULL)) {
+			diag("wrong result for item %d", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static size_t count_items(struct lfht *ht)
+{
+	size_t n = 0;
+	struct lfht_iter it;
+	for(void *cur = lfht_first(ht, &it); cur != NULL;
+		cur = lfht_next(ht, &it))
+	{
+		n++;
+	}
+	return n;
+}
+
+
+static bool all(int i) { return true; }
+static bool even(int i) { return i % 2 == 0; }
+
+
+static struct lfht *shared;
+
+
+/* adds PER_THREAD outliers of its own, then deletes every other one. */
+static void *escaper_fn(void *param)
+{
+	int first = NUM_ITEMS + (intptr_t)param * PER_THREAD;
+	bool ok = true;
+	int eck = e_begin();
+	for(int i = first; i < first + PER_THREAD; i++) {
+		void *p = fake_ptr(i);
+		ok = lfht_add(shared, ptr_hash_fn(p, NULL), p) && ok;
+	}
+	for(int i = first + 1; i < first + PER_THREAD; i += 2) {
+		void *p = fake_ptr(i);
+		ok = lfht_del(shared, ptr_hash_fn(p, NULL), p) && ok;
+	}
+	e_end(eck);
+	return ok ? param : NULL;
+}
+
+
+int main(void)
+{
+	plan_tests(16);
+
+	int eck = e_begin();
+	struct lfht ht;
+	lfht_init(&ht, &ptr_hash_fn, NULL);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		void *p = fake_ptr(i);
+		bool ok = lfht_add(&ht, ptr_hash_fn(p, NULL), p);
+		assert(ok);
+	}
+	struct lfht_stats st;
+	lfht_stats(&ht, &st);
+	ok(st.n_escaped > 0 && st.n_escaped <= NUM_ITEMS / 2,
+		"escaped=%zu", st.n_escaped);
+	ok1(check(&ht, NUM_ITEMS, &all));
+	ok1(count_items(&ht) == NUM_ITEMS);
+
+	for(int i = 1; i < NUM_ITEMS; i += 2) {
+		void *p = fake_ptr(i);
+		bool ok = lfht_del(&ht, ptr_hash_fn(p, NULL), p);
+		assert(ok);
+	}
+	ok1(check(&ht, NUM_ITEMS, &even));
+	ok1(count_items(&ht) == NUM_ITEMS / 2);
+	void *p = fake_ptr(NUM_ITEMS - 1);
+	ok1(!lfht_del(&ht, ptr_hash_fn(p, NULL), p));
+
+	struct lfht copy;
+	ok1(lfht_copy(&copy, &ht));
+	ok1(check(&copy, NUM_ITEMS, &even) && count_items(&copy) == NUM_ITEMS / 2);
+	lfht_clear(&copy);
+	lfht_clear(&ht);
+	lfht_stats(&ht, &st);
+	ok1(st.n_tables == 0 && st.n_escaped == 0);
+
+	/* the same, all at once. */
+	size_t *hashes = malloc(sizeof(size_t) * NUM_ITEMS);
+	void **ptrs = malloc(sizeof(void *) * NUM_ITEMS);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		ptrs[i] = fake_ptr(i);
+		hashes[i] = ptr_hash_fn(ptrs[i], NULL);
+	}
+	lfht_add_bulk(&ht, hashes, ptrs, NUM_ITEMS);
+	ok1(check(&ht, NUM_ITEMS, &all) && count_items(&ht) == NUM_ITEMS);
+	lfht_clear(&ht);
+
+	/* the outliers all at once, on top of the ordinary ones. */
+	for(int i = 0; i < NUM_ITEMS / 2; i++) {
+		bool ok = lfht_add(&ht, hashes[i], ptrs[i]);
+		assert(ok);
+	}
+	ok1(lfht_add_bulk(&ht, &hashes[NUM_ITEMS / 2], &ptrs[NUM_ITEMS / 2],
+		NUM_ITEMS - NUM_ITEMS / 2));
+	ok1(check(&ht, NUM_ITEMS, &all) && count_items(&ht) == NUM_ITEMS);
+	lfht_clear(&ht);
+	e_end(eck);
+	free(hashes);
+	free(ptrs);
+
+	/* several threads adding and deleting outliers. */
+	lfht_init(&ht, &ptr_hash_fn, NULL);
+	shared = &ht;
+	eck = e_begin();
+	for(int i = 0; i < NUM_ITEMS / 2; i++) {
+		void *p = fake_ptr(i);
+		bool ok = lfht_add(&ht, ptr_hash_fn(p, NULL), p);
+		assert(ok);
+	}
+	e_end(eck);
+	pthread_t ts[NUM_THREADS];
+	for(intptr_t i = 0; i < NUM_THREADS; i++) {
+		if(pthread_create(&ts[i], NULL, &escaper_fn, (void *)(i + 1)) != 0) {
+			abort();
+		}
+	}
+	bool threads_ok = true;
+	for(int i = 0; i < NUM_THREADS; i++) {
+		void *r;
+		pthread_join(ts[i], &r);
+		threads_ok = threads_ok && r != NULL;
+	}
+	eck = e_begin();
+	bool all_ok = check(&ht, NUM_ITEMS / 2, &all);
+	for(int i = NUM_ITEMS + PER_THREAD; all_ok
+		&& i < NUM_ITEMS + PER_THREAD * (NUM_THREADS + 1); i++)
+	{
+		void *p = fake_ptr(i);
+		all_ok = lfht_get(&ht, ptr_hash_fn(p, NULL), &cmp_ptr, p)
+			== (i % 2 == 0 ? p : NULL);
+	}
+	ok(threads_ok && all_ok, "threads_ok=%d, all_ok=%d", (int)threads_ok,
+		(int)all_ok);
+	lfht_stats(&ht, &st);
+	ok(st.n_escaped > 0 && count_items(&ht)
+			== NUM_ITEMS / 2 + NUM_THREADS * PER_THREAD / 2,
+		"escaped=%zu", st.n_escaped);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* the high ones escape from a table of the heap ones, and come back in
+	 * when copied without them.
+	 */
+	eck = e_begin();
+	lfht_init(&ht, &ptr_hash_fn, NULL);
+	for(int i = 0; i < NUM_ITEMS / 2; i++) {
+		void *p = fake_ptr(i);
+		bool ok = lfht_add(&ht, ptr_hash_fn(p, NULL), p);
+		assert(ok);
+	}
+	for(int i = 0; i < NUM_ITEMS / 2; i++) {
+		void *p = high_ptr(i);
+		bool ok = lfht_add(&ht, ptr_hash_fn(p, NULL), p);
+		assert(ok);
+	}
+	lfht_stats(&ht, &st);
+	size_t before = st.n_escaped;
+	for(int i = 0; i < NUM_ITEMS / 2; i++) {
+		void *p = fake_ptr(i);
+		bool ok = lfht_del(&ht, ptr_hash_fn(p, NULL), p);
+		assert(ok);
+	}
+	ok1(lfht_copy(&copy, &ht));
+	lfht_stats(&copy, &st);
+	all_ok = count_items(&copy) == NUM_ITEMS / 2;
+	for(int i = 0; i < NUM_ITEMS / 2 && all_ok; i++) {
+		void *p = high_ptr(i);
+		all_ok = lfht_get(&copy, ptr_hash_fn(p, NULL), &cmp_ptr, p) == p;
+	}
+	ok(before > 0 && st.n_escaped == 0 && all_ok,
+		"escaped=%zu -> %zu, all_ok=%d", before, st.n_escaped, (int)all_ok);
+	lfht_clear(&copy);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	return exit_status();
+}
@@ -0,0 +1,143 @@
+
+/* tests on LFHT_DEFINE_TYPE(): that the generated functions add, find,
+ * iterate over and delete items by key, that duplicates of a key come out of
+ * getfirst/getnext, and that the raw lfht is usable alongside.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+#include "lfht_type.h"
+
+
+#define NUM_ITEMS 5000
+#define NUM_DUPS 5
+
+
+struct thing {
+	unsigned key;
+	int val;
+} __attribute__((aligned(16)));
+
+
+static unsigned thing_key(const struct thing *t) {
+	return t->key;
+}
+
+
+static size_t key_hash(unsigned key) {
+	return hashl(&key, 1, 0);
+}
+
+
+static bool thing_eq(const struct thing *t, unsigned key) {
+	return t->key == key;
+}
+
+
+LFHT_DEFINE_TYPE(thing_ht, struct thing, thing_key, key_hash, thing_eq);
+
+
+static bool cmp_thing(const void *cand, void *ref) {
+	return ((const struct thing *)cand)->key == *(unsigned *)ref;
+}
+
+
+int main(void)
+{
+	plan_tests(9);
+
+	struct thing *things = calloc(NUM_ITEMS + NUM_DUPS, sizeof *things);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		things[i] = (struct thing){ .key = i * 7 + 1, .val = i };
+	}
+	for(int i = 0; i < NUM_DUPS; i++) {
+		things[NUM_ITEMS + i] = (struct thing){ .key = 8, .val = -1 - i };
+	}
+
+	int eck = e_begin();
+	struct thing_ht ht;
+	thing_ht_init(&ht);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = thing_ht_add(&ht, &things[i]);
+		assert(ok);
+	}
+	e_end(eck);
+
+	eck = e_begin();
+	bool all = true;
+	for(int i = 0; i < NUM_ITEMS && all; i++) {
+		struct thing *t = thing_ht_get(&ht, i * 7 + 1);
+		if(t != &things[i]) {
+			diag("key %u: got %p, wanted %p", i * 7 + 1, t, &things[i]);
+			all = false;
+		}
+	}
+	ok(all, "all items found by key");
+	ok1(thing_ht_get(&ht, 0) == NULL);
+	ok1(thing_ht_get(&ht, 3) == NULL);
+
+	/* the raw lfht agrees. */
+	unsigned k = 7 * 100 + 1;
+	ok1(lfht_get(&ht.raw, key_hash(k), &cmp_thing, &k) == &things[100]);
+
+	size_t n = 0;
+	struct lfht_iter it;
+	for(struct thing *t = thing_ht_first(&ht, &it); t != NULL;
+		t = thing_ht_next(&ht, &it))
+	{
+		n++;
+	}
+	ok(n == NUM_ITEMS, "iterated over %zu items", n);
+	e_end(eck);
+
+	/* duplicates: key 8 is also things[1]. */
+	eck = e_begin();
+	for(int i = 0; i < NUM_DUPS; i++) {
+		bool ok = thing_ht_add(&ht, &things[NUM_ITEMS + i]);
+		assert(ok);
+	}
+	n = 0;
+	for(struct thing *t = thing_ht_getfirst(&ht, 8, &it); t != NULL;
+		t = thing_ht_getnext(&ht, 8, &it))
+	{
+		if(t->key != 8) n = 1000;
+		n++;
+	}
+	ok(n == NUM_DUPS + 1, "found %zu of key 8", n);
+	e_end(eck);
+
+	/* delete by item and by key. */
+	eck = e_begin();
+	for(int i = 0; i < NUM_ITEMS; i += 2) {
+		bool ok = thing_ht_del(&ht, &things[i]);
+		assert(ok);
+	}
+	ok1(!thing_ht_del(&ht, &things[0]));
+	bool gone = true;
+	for(int i = 1; i < NUM_ITEMS; i += 2) {
+		if(i == 1) continue;
+		gone = thing_ht_delkey(&ht, i * 7 + 1) && gone;
+	}
+	ok1(gone && !thing_ht_delkey(&ht, 3 * 7 + 1));
+	n = 0;
+	for(struct thing *t = thing_ht_first(&ht, &it); t != NULL;
+		t = thing_ht_next(&ht, &it))
+	{
+		n++;
+	}
+	ok(n == NUM_DUPS + 1, "%zu items left", n);
+	thing_ht_clear(&ht);
+	e_end(eck);
+
+	free(things);
+
+	return exit_status();
+}
@@ -0,0 +1,174 @@
+
+/* tests on the integer-key set mode: that keys added with lfht_int_add() are
+ * found with lfht_int_get() across growth and migration, that iteration gives
+ * them back, that deletes work, that keys too scattered for the slot format
+ * still work by way of the escape table, that keys above LFHT_INT_KEY_MAX are
+ * turned away rather than truncated, that key 0 survives the mask being
+ * narrowed down to the minimum, and that a rehash_fn of one's own is still
+ * called for integer keys in a table not set up by lfht_int_init().
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <ccan/tap/tap.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_KEYS 20000
+#define NUM_WILD 200
+
+
+static int rehash_calls = 0;
+
+
+static size_t count_rehash(const void *ptr, void *priv) {
+	rehash_calls++;
+	return lfht_int_hash(lfht_int_key(ptr));
+}
+
+
+static bool all_in(struct lfht *ht, uintptr_t first, uintptr_t n, int stride)
+{
+	for(uintptr_t i = first; i < first + n; i++) {
+		if(!lfht_int_get(ht, i * stride)) {
+			diag("didn't find %lu", (unsigned long)(i * stride));
+			return false;
+		}
+	}
+	return true;
+}
+
+
+static size_t count_keys(struct lfht *ht, uintptr_t *sum)
+{
+	size_t n = 0;
+	struct lfht_iter it;
+	*sum = 0;
+	for(void *cur = lfht_first(ht, &it); cur != NULL;
+		cur = lfht_next(ht, &it))
+	{
+		*sum += lfht_int_key(cur);
+		n++;
+	}
+	return n;
+}
+
+
+int main(void)
+{
+	plan_tests(12);
+
+	/* would be 7 if shifted into a slot. */
+	uintptr_t big7 = (LFHT_INT_KEY_MAX + 1) | 7;
+	struct lfht ht;
+	lfht_int_init(&ht, 0, 0);
+	ok(!lfht_int_add(&ht, big7) && !lfht_int_add_unique(&ht, big7),
+		"over-range key not added");
+
+	/* zero included. */
+	int eck = e_begin();
+	for(uintptr_t i = 0; i < NUM_KEYS; i++) {
+		bool ok = lfht_int_add(&ht, i);
+		assert(ok);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	ok1(all_in(&ht, 0, NUM_KEYS, 1));
+	ok1(!lfht_int_get(&ht, NUM_KEYS));
+	ok1(!lfht_int_get(&ht, LFHT_INT_KEY_MAX));
+	ok1(!lfht_int_get(&ht, big7) && !lfht_int_del(&ht, big7)
+		&& lfht_int_get(&ht, 7));
+
+	uintptr_t sum;
+	size_t n = count_keys(&ht, &sum);
+	ok(n == NUM_KEYS && sum == (uintptr_t)NUM_KEYS * (NUM_KEYS - 1) / 2,
+		"iteration gave n=%zu sum=%lu", n, (unsigned long)sum);
+
+	for(uintptr_t i = 0; i < NUM_KEYS; i += 2) {
+		bool ok = lfht_int_del(&ht, i);
+		assert(ok);
+	}
+	ok1(!lfht_int_del(&ht, 0));
+	bool odd = true, even = false;
+	for(uintptr_t i = 0; i < NUM_KEYS; i++) {
+		if(i % 2 == 0) even = even || lfht_int_get(&ht, i);
+		else odd = odd && lfht_int_get(&ht, i);
+	}
+	ok(odd && !even, "odd keys remain");
+	e_end(eck);
+
+	/* keys spread all over the range. */
+	eck = e_begin();
+	uintptr_t wild[NUM_WILD];
+	uint64_t x = 0x2545f4914f6cdd1dull;
+	for(int i = 0; i < NUM_WILD; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		wild[i] = x & LFHT_INT_KEY_MAX;
+		bool ok = lfht_int_add(&ht, wild[i]);
+		assert(ok);
+	}
+	bool wild_in = true;
+	for(int i = 0; i < NUM_WILD; i++) {
+		wild_in = wild_in && lfht_int_get(&ht, wild[i]);
+	}
+	ok1(wild_in);
+	e_end(eck);
+
+	/* so does a copy. */
+	eck = e_begin();
+	struct lfht cp;
+	bool copied = lfht_copy(&cp, &ht);
+	bool same = copied;
+	for(int i = 0; i < NUM_WILD && same; i++) {
+		same = lfht_int_get(&cp, wild[i]);
+	}
+	for(uintptr_t i = 1; i < NUM_KEYS && same; i += 2) {
+		same = lfht_int_get(&cp, i);
+	}
+	ok(same, "copy has the same keys");
+	if(copied) lfht_clear(&cp);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* key 0 is nothing but common bits once the wild keys have narrowed the
+	 * mask, and mustn't make a void entry.
+	 */
+	eck = e_begin();
+	lfht_int_init(&ht, 0, 0);
+	for(uintptr_t i = 0; i < 1000; i++) {
+		bool ok = lfht_int_add(&ht, i);
+		assert(ok);
+	}
+	for(int i = 0; i < NUM_WILD; i++) {
+		bool ok = lfht_int_add(&ht, wild[i]);
+		assert(ok);
+	}
+	wild_in = true;
+	for(int i = 0; i < NUM_WILD; i++) {
+		wild_in = wild_in && lfht_int_get(&ht, wild[i]);
+	}
+	ok1(all_in(&ht, 0, 1000, 1) && wild_in);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* the same keys under a rehash_fn of one's own, through growth. */
+	eck = e_begin();
+	lfht_init(&ht, &count_rehash, NULL);
+	for(uintptr_t i = 0; i < NUM_KEYS; i++) {
+		bool ok = lfht_int_add(&ht, i);
+		assert(ok);
+	}
+	ok(all_in(&ht, 0, NUM_KEYS, 1) && rehash_calls > 0,
+		"own rehash_fn called %d times", rehash_calls);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	return exit_status();
+}
@@ -0,0 +1,233 @@
+
+/* tests on lfht_add_unique(): that it hands back the item already present,
+ * also to a call whose item would escape, or adds the new one; that threads
+ * racing to add their own copies of the same keys end up with exactly one
+ * item per key, which all of them were handed back; and that the same goes
+ * for integer keys spread all over the range, which race in the escape table
+ * as often as in the main table.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_KEYS 20000
+#define NUM_THREADS 4
+#define NUM_WILD 20000
+
+
+static pthread_barrier_t start_bar;
+
+
+static size_t str_hash_fn(const void *key, void *priv) {
+	return hashl(key, strlen(key), (uintptr_t)priv);
+}
+
+
+static bool cmp_str_ptr(const void *cand, void *ref) {
+	return strcmp(cand, ref) == 0;
+}
+
+
+struct p_param {
+	struct lfht *ht;
+	int id;
+	char **mine;		/* this thread's copies */
+	char **got;			/* what lfht_add_unique() returned */
+};
+
+
+static void *participant_fn(void *param_ptr)
+{
+	struct p_param *p = param_ptr;
+	int bn = pthread_barrier_wait(&start_bar);
+	if(bn != 0 && bn != PTHREAD_BARRIER_SERIAL_THREAD) abort();
+
+	/* each from a different starting point, so that they collide all over
+	 * the key range while the table grows.
+	 */
+	int eck = e_begin();
+	for(int i = 0; i < NUM_KEYS; i++) {
+		int k = (i + p->id * (NUM_KEYS / NUM_THREADS)) % NUM_KEYS;
+		char *s = p->mine[k];
+		int n = lfht_add_unique(p->ht, str_hash_fn(s, NULL),
+			&cmp_str_ptr, s, s, (void **)&p->got[k]);
+		if(n == 0) p->got[k] = s;
+		assert(n == 0 || n == -EEXIST);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+	return NULL;
+}
+
+
+static struct lfht *int_ht;
+static uintptr_t wild[NUM_WILD];
+static _Atomic int wins[NUM_WILD];
+
+
+static void *int_participant_fn(void *param)
+{
+	int id = (intptr_t)param;
+	int bn = pthread_barrier_wait(&start_bar);
+	if(bn != 0 && bn != PTHREAD_BARRIER_SERIAL_THREAD) abort();
+
+	int eck = e_begin();
+	for(int i = 0; i < NUM_WILD; i++) {
+		int k = (i + id * (NUM_WILD / NUM_THREADS)) % NUM_WILD;
+		if(lfht_int_add_unique(int_ht, wild[k])) atomic_fetch_add(&wins[k], 1);
+		if(i % 64 == 0) {
+			e_end(eck);
+			eck = e_begin();
+		}
+	}
+	e_end(eck);
+	return NULL;
+}
+
+
+int main(void)
+{
+	plan_tests(11);
+
+	int eck = e_begin();
+	struct lfht ht = LFHT_INITIALIZER(ht, &str_hash_fn, NULL);
+	char *a = strdup("unique-a"), *a2 = strdup("unique-a");
+	ok1(lfht_add_unique(&ht, str_hash_fn(a, NULL), &cmp_str_ptr, a, a,
+		NULL) == 0);
+	void *found = NULL;
+	ok1(lfht_add_unique(&ht, str_hash_fn(a2, NULL), &cmp_str_ptr, a2, a2,
+		&found) == -EEXIST && found == a);
+	/* nor one that'd escape, which isn't dereferenced when it isn't added. */
+	void *far = (void *)0xffffffffe0000000ul;
+	found = NULL;
+	ok1(lfht_add_unique(&ht, str_hash_fn(a2, NULL), &cmp_str_ptr, a2, far,
+		&found) == -EEXIST && found == a);
+	struct lfht_iter it;
+	size_t count = 0;
+	for(void *c = lfht_first(&ht, &it); c != NULL; c = lfht_next(&ht, &it)) {
+		count++;
+	}
+	ok1(count == 1);
+	lfht_clear(&ht);
+	e_end(eck);
+	free(a);
+	free(a2);
+
+	struct p_param ps[NUM_THREADS];
+	lfht_init(&ht, &str_hash_fn, NULL);
+	for(int t = 0; t < NUM_THREADS; t++) {
+		ps[t] = (struct p_param){
+			.ht = &ht, .id = t,
+			.mine = malloc(sizeof(char *) * NUM_KEYS),
+			.got = malloc(sizeof(char *) * NUM_KEYS),
+		};
+		for(int i = 0; i < NUM_KEYS; i++) {
+			char buf[100];
+			snprintf(buf, sizeof(buf), "unique-%05x", i);
+			ps[t].mine[i] = strdup(buf);
+		}
+	}
+	pthread_barrier_init(&start_bar, NULL, NUM_THREADS);
+	pthread_t ts[NUM_THREADS];
+	for(int t = 0; t < NUM_THREADS; t++) {
+		int n = pthread_create(&ts[t], NULL, &participant_fn, &ps[t]);
+		if(n != 0) abort();
+	}
+	for(int t = 0; t < NUM_THREADS; t++) pthread_join(ts[t], NULL);
+	pthread_barrier_destroy(&start_bar);
+
+	eck = e_begin();
+	count = 0;
+	for(void *c = lfht_first(&ht, &it); c != NULL; c = lfht_next(&ht, &it)) {
+		count++;
+	}
+	ok(count == NUM_KEYS, "one item per key (count=%zu)", count);
+
+	bool agree = true;
+	for(int i = 0; i < NUM_KEYS && agree; i++) {
+		char *s = ps[0].got[i];
+		for(int t = 1; t < NUM_THREADS; t++) {
+			agree = agree && ps[t].got[i] == s;
+		}
+		agree = agree && lfht_get(&ht, str_hash_fn(s, NULL), &cmp_str_ptr, s)
+			== s;
+	}
+	ok(agree, "all threads got the item that's in the table");
+	lfht_clear(&ht);
+	e_end(eck);
+
+	/* the integer-key form. */
+	eck = e_begin();
+	lfht_int_init(&ht, 0, 0);
+	bool first = true, again = false;
+	for(uintptr_t k = 0; k < 1000; k++) {
+		first = lfht_int_add_unique(&ht, k) && first;
+	}
+	for(uintptr_t k = 0; k < 1000; k++) {
+		again = lfht_int_add_unique(&ht, k) || again;
+	}
+	ok1(first);
+	ok1(!again);
+	count = 0;
+	for(void *c = lfht_first(&ht, &it); c != NULL; c = lfht_next(&ht, &it)) {
+		count++;
+	}
+	ok1(count == 1000);
+
+	/* racing over keys of which about half escape. */
+	uint64_t x = 0x2545f4914f6cdd1dull;
+	for(int i = 0; i < NUM_WILD; i++) {
+		x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+		wild[i] = x & LFHT_INT_KEY_MAX;
+	}
+	int_ht = &ht;
+	e_end(eck);
+	pthread_barrier_init(&start_bar, NULL, NUM_THREADS);
+	for(int t = 0; t < NUM_THREADS; t++) {
+		int n = pthread_create(&ts[t], NULL, &int_participant_fn,
+			(void *)(intptr_t)t);
+		if(n != 0) abort();
+	}
+	for(int t = 0; t < NUM_THREADS; t++) pthread_join(ts[t], NULL);
+	pthread_barrier_destroy(&start_bar);
+
+	eck = e_begin();
+	struct lfht_stats st;
+	lfht_stats(&ht, &st);
+	bool once = true;
+	for(int i = 0; i < NUM_WILD && once; i++) {
+		once = atomic_load(&wins[i]) == 1 && lfht_int_get(&ht, wild[i]);
+	}
+	ok(once && st.n_escaped > 0, "each key added once (escaped=%zu)",
+		st.n_escaped);
+	count = 0;
+	for(void *c = lfht_first(&ht, &it); c != NULL; c = lfht_next(&ht, &it)) {
+		count++;
+	}
+	ok(count == 1000 + NUM_WILD, "count=%zu", count);
+	lfht_clear(&ht);
+	e_end(eck);
+
+	for(int t = 0; t < NUM_THREADS; t++) {
+		for(int i = 0; i < NUM_KEYS; i++) free(ps[t].mine[i]);
+		free(ps[t].mine);
+		free(ps[t].got);
+	}
+
+	return exit_status();
+}
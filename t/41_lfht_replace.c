@@ -0,0 +1,198 @@
+
+/* tests on lfht_replace(): that it swaps one item for another of the same
+ * key without leaving tombstones, that it fails for items that aren't there,
+ * that it works for new items nowhere near the old ones in memory, and that
+ * concurrent readers never miss a key while it's being replaced.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include <ccan/tap/tap.h>
+#include <ccan/hash/hash.h>
+
+#include "epoch.h"
+#include "lfht.h"
+
+
+#define NUM_ITEMS 5000
+#define NUM_FLIPS 20
+#define NUM_READERS 2
+#define BLOCK_SIZE (1 << 19)
+
+
+struct rec {
+	unsigned long key;
+	int version;
+} __attribute__((aligned(32)));	/* lfht wants a malloc grain's worth */
+
+
+static size_t rec_hash(unsigned long key) {
+	return hashl(&key, 1, 0);
+}
+
+
+static size_t rehash_rec(const void *ptr, void *priv) {
+	return rec_hash(((const struct rec *)ptr)->key);
+}
+
+
+static bool cmp_rec_key(const void *cand, void *ref) {
+	return ((const struct rec *)cand)->key == *(unsigned long *)ref;
+}
+
+
+static struct rec *get_rec(struct lfht *ht, unsigned long key) {
+	return lfht_get(ht, rec_hash(key), &cmp_rec_key, &key);
+}
+
+
+/* finds the item for @key and replaces it with @new. */
+static bool replace_key(struct lfht *ht, unsigned long key, struct rec *new)
+{
+	size_t hash = rec_hash(key);
+	struct lfht_iter it;
+	for(struct rec *c = lfht_firstval(ht, &it, hash); c != NULL;
+		c = lfht_nextval(ht, &it, hash))
+	{
+		if(c->key == key) return lfht_replace(ht, &it, c, new);
+	}
+	return false;
+}
+
+
+static size_t total_tombstones(struct lfht *ht)
+{
+	struct lfht_stats st;
+	lfht_stats(ht, &st);
+	size_t n = 0;
+	for(size_t i = 0; i < st.n_tables && i < LFHT_STATS_MAX_TABLES; i++) {
+		n += st.tables[i].tombstones;
+	}
+	return n;
+}
+
+
+static struct lfht *shared;
+static struct rec *versions[2];
+static _Atomic bool done = false;
+
+
+static void *reader_fn(void *param)
+{
+	size_t misses = 0;
+	while(!atomic_load(&done)) {
+		int eck = e_begin();
+		for(unsigned long k = 0; k < NUM_ITEMS; k++) {
+			if(get_rec(shared, k) == NULL) misses++;
+		}
+		e_end(eck);
+	}
+	return (void *)misses;
+}
+
+
+static struct rec far_rec = { .key = 7, .version = 99 };
+
+
+int main(void)
+{
+	plan_tests(8);
+
+	/* both versions within an aligned block no bigger than the first table,
+	 * whose common bits start above its size; so that they all fit and the
+	 * first part takes the fast path throughout.
+	 */
+	struct rec *v0 = aligned_alloc(BLOCK_SIZE, BLOCK_SIZE),
+		*v1 = &v0[NUM_ITEMS];
+	assert(sizeof *v0 * NUM_ITEMS * 2 <= BLOCK_SIZE);
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		v0[i] = (struct rec){ .key = i, .version = 0 };
+		v1[i] = (struct rec){ .key = i, .version = 1 };
+	}
+
+	/* also big enough that there's no migration to make tombstones of its
+	 * own.
+	 */
+	struct lfht ht;
+	lfht_init_sized(&ht, &rehash_rec, NULL, BLOCK_SIZE);
+	int eck = e_begin();
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&ht, rec_hash(i), &v0[i]);
+		assert(ok);
+	}
+	ok1(total_tombstones(&ht) == 0);
+
+	bool all = true;
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		all = replace_key(&ht, i, &v1[i]) && all;
+	}
+	ok(all, "all replaced");
+	all = true;
+	for(int i = 0; i < NUM_ITEMS && all; i++) {
+		all = get_rec(&ht, i) == &v1[i];
+	}
+	ok(all, "new versions found");
+	ok(total_tombstones(&ht) == 0, "no tombstones (%zu)",
+		total_tombstones(&ht));
+
+	/* not there. */
+	struct lfht_iter it;
+	size_t hash = rec_hash(1);
+	lfht_firstval(&ht, &it, hash);
+	ok1(!lfht_replace(&ht, &it, &v0[1], &v0[1]));
+
+	/* a static item, whose address shares few bits with the heap's. */
+	ok1(replace_key(&ht, 7, &far_rec) && get_rec(&ht, 7) == &far_rec);
+	ok1(replace_key(&ht, 7, &v0[7]) && get_rec(&ht, 7) == &v0[7]);
+	e_end(eck);
+
+	/* flip between versions while others look; start small so that the
+	 * table grows and migrates underneath.
+	 */
+	eck = e_begin();
+	lfht_clear(&ht);
+	e_end(eck);
+	lfht_init(&ht, &rehash_rec, NULL);
+	shared = &ht;
+	versions[0] = v0;
+	versions[1] = v1;
+	eck = e_begin();
+	for(int i = 0; i < NUM_ITEMS; i++) {
+		bool ok = lfht_add(&ht, rec_hash(i), &v0[i]);
+		assert(ok);
+	}
+	e_end(eck);
+	pthread_t rs[NUM_READERS];
+	for(int i = 0; i < NUM_READERS; i++) {
+		if(pthread_create(&rs[i], NULL, &reader_fn, NULL) != 0) abort();
+	}
+	bool flips_ok = true;
+	for(int f = 1; f <= NUM_FLIPS; f++) {
+		eck = e_begin();
+		for(int i = 0; i < NUM_ITEMS; i++) {
+			flips_ok = replace_key(&ht, i, &versions[f % 2][i]) && flips_ok;
+		}
+		e_end(eck);
+	}
+	atomic_store(&done, true);
+	size_t misses = 0;
+	for(int i = 0; i < NUM_READERS; i++) {
+		void *r;
+		pthread_join(rs[i], &r);
+		misses += (size_t)r;
+	}
+	ok(flips_ok && misses == 0, "flips_ok=%d, misses=%zu",
+		(int)flips_ok, misses);
+
+	eck = e_begin();
+	lfht_clear(&ht);
+	e_end(eck);
+	free(v0);
+
+	return exit_status();
+}